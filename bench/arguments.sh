@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Run time of 42sh on single commands with a growing number of arguments:
+# a builtin that ignores them (parsing only), echo and a for loop over them
+# (parsing and indexing every argument). With O(1) access to the sons of a
+# node, the time per argument stays flat as the count doubles.
+#
+# usage: bench/arguments.sh [path/to/42sh] [argument counts...]
+
+. "$(dirname "$0")/common.sh"
+
+SHELL_BIN=${1:-src/42sh}
+[ $# -gt 0 ] && shift
+COUNTS=${*:-"25000 50000 100000 200000"}
+
+script=/tmp/42sh_bench_arguments.sh
+words=/tmp/42sh_bench_arguments.txt
+
+# per_arg SECONDS COUNT: prints the time per argument in microseconds
+per_arg() {
+    echo "$1 $2" | awk '{ printf "%.2f", $1 * 1000000 / $2 }'
+}
+
+printf "%10s %10s %10s %10s %12s %12s %12s\n" "arguments" "true(s)" \
+    "echo(s)" "for(s)" "true(us/arg)" "echo(us/arg)" "for(us/arg)"
+for count in $COUNTS; do
+    seq "$count" | sed 's/^/argument/' | tr '\n' ' ' > "$words"
+
+    { printf 'true '; cat "$words"; echo; } > "$script"
+    t=$(seconds "$SHELL_BIN" "$script")
+    { printf 'echo '; cat "$words"; echo; } > "$script"
+    e=$(seconds "$SHELL_BIN" "$script")
+    { printf 'for a in '; cat "$words"; echo '; do true; done'; } > "$script"
+    f=$(seconds "$SHELL_BIN" "$script")
+
+    printf "%10s %10s %10s %10s %12s %12s %12s\n" "$count" "$t" "$e" "$f" \
+        "$(per_arg "$t" "$count")" "$(per_arg "$e" "$count")" \
+        "$(per_arg "$f" "$count")"
+done
+
+rm -f "$script" "$words"
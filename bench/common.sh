@@ -0,0 +1,9 @@
+# Helpers shared by the benchmarks, which source this file.
+
+# seconds COMMAND...: prints the wall clock time of the command
+seconds() {
+    start=$(date +%s%N)
+    "$@" > /dev/null 2>&1
+    end=$(date +%s%N)
+    echo "$(((end - start) / 1000000))" | awk '{ printf "%.3f", $1 / 1000 }'
+}
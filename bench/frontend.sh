@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# Front-end throughput of 42sh: reads, lexes and parses scripts without
+# running them (--parse-only), and prints the time, heap and rate of each
+# phase as reported by the shell. Without scripts, the test suite and a
+# generated script of SIZE MiB are measured.
+#
+# usage: bench/frontend.sh [path/to/42sh] [scripts...]
+
+SHELL_BIN=${1:-src/42sh}
+[ $# -gt 0 ] && shift
+SIZE=${SIZE:-16}
+
+generated=/tmp/42sh_bench_frontend.sh
+if [ $# -eq 0 ]; then
+    line='var=value; if true; then echo "a $var" b > /dev/null; fi'
+    bytes=$((SIZE * 1024 * 1024))
+    yes "$line" | head -n $((bytes / (${#line} + 1))) > "$generated"
+    set -- $(find tests -type f ! -name '*.sh' ! -name 'Makefile*') \
+        "$generated"
+fi
+
+# Sums the phases of every script that parses
+for script in "$@"; do
+    "$SHELL_BIN" --parse-only "$script" 2>&1 > /dev/null \
+        | awk -v script="$script" '$1 == "total" { total = 1 }
+            $1 == "io" || $1 == "lex" || $1 == "parse" { line[$1] = $0 }
+            END { if (total) for (p in line) print line[p] }'
+done | awk '{ time[$1] += $2; heap[$1] += $3; count[$1] += $4; unit[$1] = $5 }
+    END {
+        printf "%-8s %12s %12s %12s %-7s %14s\n", "phase", "time(ms)",
+            "heap(KiB)", "count", "unit", "rate(/s)"
+        split("io lex parse", phases, " ")
+        for (i = 1; i <= 3; ++i) {
+            p = phases[i]
+            rate = time[p] > 0 ? count[p] * 1000 / time[p] : 0
+            printf "%-8s %12.3f %12.1f %12d %-7s %14.0f\n", p, time[p],
+                heap[p], count[p], unit[p], rate
+        }
+    }'
+
+rm -f "$generated"
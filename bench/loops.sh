@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# Run time of 42sh on tight loops of builtins, run by the tree executor and
+# by the bytecode VM (--bytecode). Loops are nested for loops, the shell has
+# no arithmetic to count with: the iteration count is OUTER * INNER.
+#
+# usage: bench/loops.sh [path/to/42sh] [outer count] [inner count]
+
+. "$(dirname "$0")/common.sh"
+
+SHELL_BIN=${1:-src/42sh}
+OUTER=${2:-100}
+INNER=${3:-1000}
+
+script=/tmp/42sh_bench_loops.sh
+
+# loop NAME BODY: times BODY run OUTER * INNER times with both executors
+loop() {
+    {
+        printf 'for a in %s\ndo\n' "$(seq "$OUTER" | tr '\n' ' ')"
+        printf 'for b in %s\ndo\n' "$(seq "$INNER" | tr '\n' ' ')"
+        printf '%s\n' "$2"
+        printf 'done\ndone\n'
+    } > "$script"
+    tree=$(seconds "$SHELL_BIN" "$script")
+    vm=$(seconds "$SHELL_BIN" --bytecode "$script")
+    printf "%-12s %10s %10s %8s\n" "$1" "$tree" "$vm" \
+        "$(echo "$tree $vm" | awk '{ if ($2 > 0) printf "%.1fx", $1 / $2 }')"
+}
+
+printf "%-12s %10s %10s %8s\n" "body" "tree(s)" "bytecode(s)" "speedup"
+loop "true" "true"
+loop "and-or" "true && false || true"
+loop "if" "if false; then true; elif true; then true; else false; fi"
+loop "while" "while true; do break; done"
+loop "continue" "if true; then continue; fi; false"
+
+rm -f "$script"
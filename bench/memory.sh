@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# Peak resident memory of 42sh while running straight-line scripts of
+# growing size. With the sliding-window reader, the peak should stay flat.
+#
+# usage: bench/memory.sh [path/to/42sh] [sizes in MiB...]
+
+SHELL_BIN=${1:-src/42sh}
+[ $# -gt 0 ] && shift
+SIZES=${*:-"1 8 64 256"}
+
+script=/tmp/42sh_bench_memory.sh
+line='var=value; true argument another_argument'
+
+# peak_rss PID: samples VmRSS until the process exits, prints the max in kB
+peak_rss() {
+    peak=0
+    while rss=$(awk '/^VmRSS/ { print $2 }' "/proc/$1/status" 2>/dev/null) \
+        && [ -n "$rss" ]; do
+        [ "$rss" -gt "$peak" ] && peak=$rss
+        sleep 0.01
+    done
+    echo "$peak"
+}
+
+printf "%10s %12s %14s\n" "size(MiB)" "lines" "peak RSS(kB)"
+for size in $SIZES; do
+    bytes=$((size * 1024 * 1024))
+    lines=$((bytes / (${#line} + 1)))
+    yes "$line" | head -n "$lines" > "$script"
+
+    "$SHELL_BIN" "$script" > /dev/null &
+    pid=$!
+    rss=$(peak_rss $pid)
+    wait $pid
+
+    printf "%10s %12s %14s\n" "$size" "$lines" "$rss"
+done
+
+rm -f "$script"
@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# Run time of 42sh on a loop running the same program, with PATH made of
+# DIRS directories of which only the last has it. With strace, the calls to
+# execve and stat made by the shell and its children are counted too. A
+# second 42sh, built from before the path cache, is run alongside.
+#
+# usage: bench/path.sh [path/to/42sh] [path/to/other/42sh] [count] [dirs]
+
+. "$(dirname "$0")/common.sh"
+
+SHELL_BIN=${1:-src/42sh}
+OTHER_BIN=$2
+COUNT=${3:-2000}
+DIRS=${4:-16}
+
+script=/tmp/42sh_bench_path.sh
+dirs=/tmp/42sh_bench_path
+
+# calls SYSCALL COMMAND...: prints how many times the command made it
+calls() {
+    name=$1
+    shift
+    if ! command -v strace > /dev/null 2>&1; then
+        echo "-"
+        return
+    fi
+    strace -f -c -e trace="$name" -o /tmp/42sh_bench_path.strace "$@" \
+        > /dev/null 2>&1
+    awk -v name="$name" '$NF == name { print $4; found = 1 }
+        END { if (!found) print 0 }' /tmp/42sh_bench_path.strace
+    rm -f /tmp/42sh_bench_path.strace
+}
+
+# run NAME BIN: times BIN on the script and counts its execve and stat
+run() {
+    printf "%-24s %10s %10s %10s\n" "$1" "$(seconds "$2" "$script")" \
+        "$(calls execve "$2" "$script")" \
+        "$(calls newfstatat "$2" "$script")"
+}
+
+path=
+for i in $(seq "$DIRS"); do
+    mkdir -p "$dirs/$i"
+    path="$path$dirs/$i:"
+done
+path="$path$(dirname "$(command -v test)")"
+
+{
+    printf 'export PATH=%s\n' "$path"
+    printf 'for a in %s\ndo\ntest 1\ndone\n' "$(seq "$COUNT" | tr '\n' ' ')"
+} > "$script"
+
+printf "%-24s %10s %10s %10s\n" "shell" "time(s)" "execve" "stat"
+run "$SHELL_BIN" "$SHELL_BIN"
+[ -n "$OTHER_BIN" ] && run "$OTHER_BIN" "$OTHER_BIN"
+
+rm -rf "$script" "$dirs"
@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Time to the first command and total run time of 42sh on straight-line
+# scripts of growing size, lexed in order or ahead on other threads
+# (--pretokenize). The scripts only run builtins, so lexing and parsing
+# dominate. Scripts are only pre-tokenized with at least 2 processors.
+#
+# usage: bench/pretokenize.sh [path/to/42sh] [sizes in MiB...]
+
+. "$(dirname "$0")/common.sh"
+
+SHELL_BIN=${1:-src/42sh}
+[ $# -gt 0 ] && shift
+SIZES=${*:-"4 16 64"}
+
+script=/tmp/42sh_bench_pretokenize.sh
+first=/tmp/42sh_bench_pretokenize_first.sh
+line='var=value; true "argument $var" another_argument # comment'
+
+printf "%10s %12s %14s %14s %14s %14s\n" "size(MiB)" "lines" \
+    "first(s) seq" "first(s) par" "total(s) seq" "total(s) par"
+for size in $SIZES; do
+    bytes=$((size * 1024 * 1024))
+    lines=$((bytes / (${#line} + 1)))
+    yes "$line" | head -n "$lines" > "$script"
+    # The first command exits: the run ends once it has been parsed
+    { echo 'exit 0'; cat "$script"; } > "$first"
+
+    printf "%10s %12s %14s %14s %14s %14s\n" "$size" "$lines" \
+        "$(seconds "$SHELL_BIN" "$first")" \
+        "$(seconds "$SHELL_BIN" --pretokenize "$first")" \
+        "$(seconds "$SHELL_BIN" "$script")" \
+        "$(seconds "$SHELL_BIN" --pretokenize "$script")"
+done
+
+rm -f "$script" "$first"
@@ -1,41 +1,146 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, MADV_DONTNEED
+
 #include "io.h"
 
-FILE *StringToFile(char *string)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int prefetch_enabled = 1;
+
+void IO_set_prefetch(int enabled)
+{
+    prefetch_enabled = enabled;
+}
+
+void IO_prefetch_fd(int fd)
 {
-    return fmemopen(string, strlen(string), "r");
+    if (!prefetch_enabled)
+        return;
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, IO_PREFETCH_SIZE, POSIX_FADV_WILLNEED);
+}
+
+/*
+** Asks the kernel to start reading the next window of the file once the bytes
+** read from it get close to the end of what has already been requested.
+*/
+static void file_prefetch(struct IO *io)
+{
+    if (!prefetch_enabled || io->prefetched >= io->capacity
+        || io->size + IO_PREFETCH_SIZE / 2 < io->prefetched)
+        return;
+
+    posix_fadvise(io->fd, io->prefetched, IO_PREFETCH_SIZE,
+                  POSIX_FADV_WILLNEED);
+    io->prefetched += IO_PREFETCH_SIZE;
 }
 
-FILE *StdinToFile(void)
+// Makes room for IO_CHUNK_SIZE more bytes in the buffer of a stream
+static int stream_grow(struct IO *io)
 {
-    FILE *fptr;
-    char buffer[1024]; // Buffer pour stocker les données lues
+    if (io->size + IO_CHUNK_SIZE <= io->capacity)
+        return 1;
 
-    // Ouvrir un fichier pour l'écriture
-    fptr = fopen("output.txt", "w");
-    if (fptr == NULL)
+    size_t capacity = io->capacity ? io->capacity : IO_CHUNK_SIZE;
+    while (io->size + IO_CHUNK_SIZE > capacity)
+        capacity *= 2;
+
+    char *buffer = realloc(io->buffer, capacity);
+    if (buffer == NULL)
     {
-        fprintf(stderr, "Error opening file.\n");
-        return NULL;
+        fprintf(stderr, "stream_grow: realloc failed\n");
+        return 0;
     }
+    io->buffer = buffer;
+    io->capacity = capacity;
+    return 1;
+}
+
+/*
+** Reads whatever is currently available on the stream and appends it to the
+** buffer. Returns 0 once the end of the stream has been reached. A mapped
+** file is read up to the size it had when it was opened.
+*/
+static int stream_fill(struct IO *io)
+{
+    if (io->eof)
+        return 0;
 
-    // Lire les données de stdin et les écrire dans le fichier
-    while (fgets(buffer, sizeof(buffer), stdin))
-        fputs(buffer, fptr);
+    size_t length = IO_CHUNK_SIZE;
+    if (io->mapped)
+    {
+        length = io->capacity - io->size;
+        if (length > IO_READ_SIZE)
+            length = IO_READ_SIZE;
+    }
+    else if (!stream_grow(io))
+        length = 0;
 
-    fclose(fptr);
+    ssize_t r = 0;
+    if (length > 0)
+    {
+        do
+            r = read(io->fd, io->buffer + io->size, length);
+        while (r == -1 && errno == EINTR);
+    }
 
-    fptr = fopen("output.txt", "r");
-    if (fptr == NULL)
+    if (r <= 0)
     {
-        fprintf(stderr, "Error reopening file for reading.\n");
-        return NULL; // Return NULL to indicate error
+        io->eof = 1;
+        return 0;
     }
 
-    return fptr;
+    io->size += r;
+    if (io->mapped)
+        file_prefetch(io);
+    return 1;
+}
+
+/*
+** Reads a regular file into a private mapping of its size, so that it never
+** moves. The file itself is not mapped: a script may shrink it while it runs,
+** and touching a page of the mapping past its new end would be a SIGBUS.
+** Anything that cannot be mapped (pipes, character devices...) is read as a
+** stream instead.
+*/
+static int file_open(struct IO *io, char *path)
+{
+    io->fd = open(path, O_RDONLY);
+    if (io->fd == -1)
+        return 0;
+
+    struct stat st;
+    if (fstat(io->fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return 1;
+
+    IO_prefetch_fd(io->fd);
+    if (st.st_size == 0)
+    {
+        io->eof = 1;
+        return 1;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+        return 1;
+
+    io->buffer = data;
+    io->capacity = st.st_size;
+    io->mapped = 1;
+    io->prefetched = prefetch_enabled ? IO_PREFETCH_SIZE : 0;
+    return 1;
 }
 
 struct IO *IO_create(enum IO_type type, char *input)
 {
+    if (type == IO_STRING)
+        return input == NULL ? NULL : IO_create_buffer(input, strlen(input));
+
     struct IO *io = calloc(sizeof(struct IO), 1);
     if (io == NULL)
     {
@@ -43,18 +148,20 @@ struct IO *IO_create(enum IO_type type, char *input)
         return NULL;
     }
 
+    io->type = type;
     switch (type)
     {
     case IO_STDIN:
-        io->input = StdinToFile();
+        io->fd = STDIN_FILENO;
+        IO_prefetch_fd(io->fd); // only has an effect if stdin is a file
         break;
 
     case IO_FILE:
-        io->input = fopen(input, "r");
-        break;
-
-    case IO_STRING:
-        io->input = StringToFile(input);
+        if (!file_open(io, input))
+        {
+            free(io);
+            return NULL;
+        }
         break;
 
     default:
@@ -63,39 +170,166 @@ struct IO *IO_create(enum IO_type type, char *input)
         return NULL;
     }
 
-    save(io);
     return io;
 }
 
+struct IO *IO_create_buffer(char *buffer, size_t size)
+{
+    struct IO *io = calloc(sizeof(struct IO), 1);
+    if (io == NULL)
+    {
+        fprintf(stderr, "IO_create_buffer: malloc failed\n");
+        return NULL;
+    }
+
+    io->type = IO_STRING;
+    io->fd = -1;
+    io->buffer = buffer;
+    io->size = size;
+    io->eof = 1;
+    return io;
+}
+
+struct IO *IO_create_view(struct IO *io, size_t offset)
+{
+    size_t start = offset - io->discarded;
+    struct IO *view = IO_create_buffer(io->buffer + start, io->size - start);
+    if (view != NULL)
+        view->discarded = offset;
+
+    return view;
+}
+
 void IO_free(struct IO *io)
 {
     if (io)
     {
-        if (io->input)
-            fclose(io->input);
+        if (io->mapped)
+            munmap(io->buffer, io->capacity);
+        else if (io->type != IO_STRING)
+            free(io->buffer);
 
+        if (io->type == IO_FILE)
+            close(io->fd);
         free(io);
     }
 }
 
 char get_char(struct IO *io)
 {
-    return fgetc(io->input);
+    if (io->pos == io->size && !stream_fill(io))
+        return EOF;
+
+    return io->buffer[io->pos++];
 }
 
 char peek_char(struct IO *io)
 {
-    char c = fgetc(io->input);
-    ungetc(c, io->input);
-    return c;
+    if (io->pos == io->size && !stream_fill(io))
+        return EOF;
+
+    return io->buffer[io->pos];
+}
+
+void unget_char(struct IO *io)
+{
+    if (io->pos > 0)
+        --io->pos;
+}
+
+const char *IO_run(struct IO *io, size_t *len)
+{
+    if (io->pos == io->size)
+        stream_fill(io);
+
+    *len = io->size - io->pos;
+    return io->buffer + io->pos;
+}
+
+const char *IO_ahead(struct IO *io, size_t offset, size_t *len)
+{
+    size_t start = offset - io->discarded;
+    while (start >= io->size && stream_fill(io))
+        continue;
+
+    *len = start < io->size ? io->size - start : 0;
+    return io->buffer + start;
+}
+
+void IO_skip(struct IO *io, size_t n)
+{
+    io->pos += n;
+}
+
+int IO_load(struct IO *io)
+{
+    if (io->type == IO_STRING)
+        return 1;
+    if (!io->mapped)
+        return 0;
+
+    while (stream_fill(io))
+        continue;
+    return 1;
+}
+
+size_t IO_tell(struct IO *io)
+{
+    return io->discarded + io->pos;
+}
+
+const char *IO_view(struct IO *io, size_t offset)
+{
+    return io->buffer + (offset - io->discarded);
+}
+
+/*
+** Gives the pages of the mapping before 'keep' back to the kernel. They are
+** only released by batches of IO_RELEASE_SIZE to keep the syscalls rare.
+*/
+static void mapping_release(struct IO *io, size_t keep)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t end = keep - keep % page_size;
+    if (end < io->released + IO_RELEASE_SIZE)
+        return;
+
+    madvise(io->buffer + io->released, end - io->released, MADV_DONTNEED);
+    io->released = end;
 }
 
-void save(struct IO *io)
+/*
+** Moves the bytes from 'keep' onwards to the start of the buffer, and shrinks
+** the buffer if a big unit made it grow.
+*/
+static void stream_compact(struct IO *io, size_t keep)
 {
-    io->saved_pos = ftell(io->input);
+    memmove(io->buffer, io->buffer + keep, io->size - keep);
+    io->size -= keep;
+    io->pos -= keep;
+    io->discarded += keep;
+
+    if (io->capacity > 4 * IO_CHUNK_SIZE && io->size < io->capacity / 4)
+    {
+        char *buffer = realloc(io->buffer, io->capacity / 2);
+        if (buffer != NULL)
+        {
+            io->buffer = buffer;
+            io->capacity /= 2;
+        }
+    }
 }
 
-void restore(struct IO *io)
+void IO_discard(struct IO *io)
 {
-    fseek(io->input, io->saved_pos, SEEK_SET);
+    if (io->type == IO_STRING || io->pos == 0)
+        return;
+
+    // Keep the last character read, so that it can still be put back
+    size_t keep = io->pos - 1;
+
+    if (io->mapped)
+        mapping_release(io, keep);
+    else
+        stream_compact(io, keep);
 }
@@ -7,6 +7,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define IO_CHUNK_SIZE 4096 // How many bytes are read from a stream at once
+#define IO_RELEASE_SIZE (256 * 1024) // Consumed mapping given back at once
+#define IO_PREFETCH_SIZE (1024 * 1024) // File read ahead of the buffer
+#define IO_READ_SIZE (64 * 1024) // How many bytes of a file are read at once
+
 enum IO_type
 {
     IO_STDIN,
@@ -16,20 +21,54 @@ enum IO_type
 
 struct IO
 {
-    FILE *input;
-    long saved_pos;
+    enum IO_type type;
+
+    // Every source is read from a byte buffer. Streams are appended to it as
+    // they are read, regular files are read into a mapping of their size and
+    // strings are read in place.
+    int fd;
+    char *buffer;
+    size_t size; // Number of valid bytes in the buffer
+    size_t capacity; // Size of the buffer, of the whole file if mapped
+    size_t pos; // Read head, as an offset in the buffer
+    size_t discarded; // Bytes of the input dropped before the buffer start
+    int eof;
+    int mapped; // The buffer is a mapping of the size of the file
+    size_t released; // Bytes at the start of the mapping already given back
+    size_t prefetched; // Bytes of the file already requested from disk
 };
 
 /*
-** \brief Creates a new file from a string.
+** \brief Enables or disables read-ahead hints on input files (default: on).
+** Must be called before the IO structs are created.
+*/
+void IO_set_prefetch(int enabled);
+
+/*
+** \brief Tells the kernel that the given file will be read sequentially, so
+** that it starts reading it ahead. Does nothing if prefetching is disabled.
 */
-FILE *StringToFile(char *string);
+void IO_prefetch_fd(int fd);
 
 /*
 ** \brief Creates a new IO struct given an input string.
+** With IO_STRING, the string is read in place and must outlive the IO.
 */
 struct IO *IO_create(enum IO_type type, char *input);
 
+/*
+** \brief Creates a new IO struct reading 'size' bytes of a caller-owned
+** buffer in place. The buffer must outlive the IO.
+*/
+struct IO *IO_create_buffer(char *buffer, size_t size);
+
+/*
+** \brief Creates a new IO struct reading the input of io in place from the
+** given position (as given by IO_tell), with the same positions. The input
+** must be fully in memory (see IO_load), and io must outlive the view.
+*/
+struct IO *IO_create_view(struct IO *io, size_t offset);
+
 /*
 ** \brief Free the given IO struct and closes its input file.
 */
@@ -46,13 +85,55 @@ char get_char(struct IO *io);
 char peek_char(struct IO *io);
 
 /*
-** \brief Saves the current position of the cursor
+** \brief Moves the cursor one character back
+*/
+void unget_char(struct IO *io);
+
+/*
+** \brief Returns the bytes following the cursor that are already in memory,
+** reading more of the stream only if there are none, and stores their number
+** in len. len is 0 at the end of the input.
+*/
+const char *IO_run(struct IO *io, size_t *len);
+
+/*
+** \brief Moves the cursor n bytes forward, n must not go past the bytes
+** already in memory (as given by IO_run or IO_ahead).
+*/
+void IO_skip(struct IO *io, size_t n);
+
+/*
+** \brief Returns the bytes from the given position (as given by IO_tell, and
+** after the cursor) that are already in memory, reading more of the stream
+** only if there are none, and stores their number in len. len is 0 at the end
+** of the input. The cursor does not move.
+*/
+const char *IO_ahead(struct IO *io, size_t offset, size_t *len);
+
+/*
+** \brief Reads the rest of the input in memory, for it to be viewed at once.
+** Returns 0 if it cannot be: a stream is only kept as a sliding window.
+*/
+int IO_load(struct IO *io);
+
+/*
+** \brief Returns the position of the cursor from the start of the input,
+** which unlike io->pos is not shifted by IO_discard.
+*/
+size_t IO_tell(struct IO *io);
+
+/*
+** \brief Returns the input from the given position (as given by IO_tell),
+** which must not have been discarded. Reading more of a stream may move its
+** buffer: the pointer is only valid until the next read.
 */
-void save(struct IO *io);
+const char *IO_view(struct IO *io, size_t offset);
 
 /*
-** \brief Restores the cursor to the last saved position
+** \brief Forgets everything before the cursor, so that only a sliding window
+** of the input stays in memory. The input cannot be read back past this point
+** afterwards.
 */
-void restore(struct IO *io);
+void IO_discard(struct IO *io);
 
 #endif // IO_H
@@ -0,0 +1,110 @@
+#include "scan.h"
+
+#include <pthread.h>
+
+#if !defined(SCAN_NO_SIMD) && (defined(__x86_64__) || defined(__i386__))
+#    define SCAN_X86
+#    include <immintrin.h>
+#endif
+
+typedef size_t (*scan_function)(const char *buffer, size_t len,
+                                const char *stops, size_t nb_stops);
+
+static size_t scan_scalar(const char *buffer, size_t len, const char *stops,
+                          size_t nb_stops)
+{
+    for (size_t i = 0; i < len; ++i)
+        for (size_t k = 0; k < nb_stops; ++k)
+            if (buffer[i] == stops[k])
+                return i;
+
+    return len;
+}
+
+#ifdef SCAN_X86
+
+__attribute__((target("sse2"))) static size_t
+scan_sse2(const char *buffer, size_t len, const char *stops, size_t nb_stops)
+{
+    __m128i needles[SCAN_MAX_STOPS];
+    for (size_t k = 0; k < nb_stops; ++k)
+        needles[k] = _mm_set1_epi8(stops[k]);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(buffer + i));
+        __m128i hits = _mm_setzero_si128();
+        for (size_t k = 0; k < nb_stops; ++k)
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[k]));
+
+        unsigned mask = _mm_movemask_epi8(hits);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    return i + scan_scalar(buffer + i, len - i, stops, nb_stops);
+}
+
+__attribute__((target("avx2"))) static size_t
+scan_avx2(const char *buffer, size_t len, const char *stops, size_t nb_stops)
+{
+    __m256i needles[SCAN_MAX_STOPS];
+    for (size_t k = 0; k < nb_stops; ++k)
+        needles[k] = _mm256_set1_epi8(stops[k]);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(buffer + i));
+        __m256i hits = _mm256_setzero_si256();
+        for (size_t k = 0; k < nb_stops; ++k)
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, needles[k]));
+
+        unsigned mask = _mm256_movemask_epi8(hits);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    // the tail is shorter than a block
+    return i + scan_sse2(buffer + i, len - i, stops, nb_stops);
+}
+
+static scan_function scan_select(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return scan_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return scan_sse2;
+    return scan_scalar;
+}
+
+#else
+
+static scan_function scan_select(void)
+{
+    return scan_scalar;
+}
+
+#endif /* SCAN_X86 */
+
+// The kernel of scan_until, selected once whichever thread calls it first
+static scan_function scan = NULL;
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+static void scan_init(void)
+{
+    scan = scan_select();
+}
+
+size_t scan_until(const char *buffer, size_t len, const char *stops,
+                  size_t nb_stops)
+{
+    pthread_once(&scan_once, scan_init);
+
+    if (nb_stops > SCAN_MAX_STOPS)
+        return scan_scalar(buffer, len, stops, nb_stops);
+
+    return scan(buffer, len, stops, nb_stops);
+}
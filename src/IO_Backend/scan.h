@@ -0,0 +1,17 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+#define SCAN_MAX_STOPS 32 // Most bytes scan_until can look for at once
+
+/*
+** \brief Returns the offset of the first byte of buffer[0, len) that is one
+** of the nb_stops bytes of stops, or len if there is none.
+** The buffer is scanned 32 or 16 bytes at a time when the CPU supports AVX2
+** or SSE2, which is checked on the first call.
+*/
+size_t scan_until(const char *buffer, size_t len, const char *stops,
+                  size_t nb_stops);
+
+#endif /* !SCAN_H */
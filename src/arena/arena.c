@@ -0,0 +1,150 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The data of a block starts after its header, aligned
+#define ARENA_HEADER_SIZE                                                      \
+    ((sizeof(struct arena_block) + ARENA_ALIGN - 1)                            \
+     & ~(size_t)(ARENA_ALIGN - 1))
+
+static size_t align(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static char *block_data(struct arena_block *block)
+{
+    return (char *)block + ARENA_HEADER_SIZE;
+}
+
+static struct arena_block *block_new(size_t size)
+{
+    if (size < ARENA_BLOCK_SIZE)
+        size = ARENA_BLOCK_SIZE;
+
+    struct arena_block *block = malloc(ARENA_HEADER_SIZE + size);
+    if (block == NULL)
+    {
+        fprintf(stderr, "arena_alloc: malloc failed\n");
+        return NULL;
+    }
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void arena_init(struct arena *arena)
+{
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->last = NULL;
+}
+
+// Makes current a block with size free bytes, reusing the next ones if they
+// are big enough
+static int arena_reserve(struct arena *arena, size_t size)
+{
+    struct arena_block *current = arena->current;
+    if (current != NULL && current->size - current->used >= size)
+        return 1;
+
+    if (current != NULL && current->next != NULL
+        && current->next->size >= size)
+    {
+        arena->current = current->next;
+        arena->current->used = 0;
+        return 1;
+    }
+
+    struct arena_block *block = block_new(size);
+    if (block == NULL)
+        return 0;
+
+    if (current == NULL)
+        arena->first = block;
+    else
+    {
+        block->next = current->next;
+        current->next = block;
+    }
+    arena->current = block;
+    return 1;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    size = align(size);
+    if (!arena_reserve(arena, size))
+        return NULL;
+
+    struct arena_block *block = arena->current;
+    char *ptr = block_data(block) + block->used;
+    block->used += size;
+    memset(ptr, 0, size);
+
+    arena->last = ptr;
+    return ptr;
+}
+
+void *arena_grow(struct arena *arena, void *ptr, size_t old_size,
+                 size_t new_size)
+{
+    struct arena_block *block = arena->current;
+    if (ptr != NULL && ptr == arena->last
+        && (char *)ptr + align(new_size) <= block_data(block) + block->size)
+    {
+        block->used = (char *)ptr + align(new_size) - block_data(block);
+        memset((char *)ptr + old_size, 0, new_size - old_size);
+        return ptr;
+    }
+
+    char *new = arena_alloc(arena, new_size);
+    if (new != NULL && ptr != NULL)
+        memcpy(new, ptr, old_size);
+    return new;
+}
+
+struct arena_mark arena_save(const struct arena *arena)
+{
+    struct arena_mark mark = { .block = arena->current, .used = 0 };
+    if (arena->current != NULL)
+        mark.used = arena->current->used;
+    return mark;
+}
+
+void arena_rewind(struct arena *arena, struct arena_mark mark)
+{
+    if (mark.block == NULL)
+    {
+        arena_reset(arena);
+        return;
+    }
+
+    arena->current = mark.block;
+    arena->current->used = mark.used;
+    arena->last = NULL;
+}
+
+void arena_reset(struct arena *arena)
+{
+    arena->current = arena->first;
+    if (arena->current != NULL)
+        arena->current->used = 0;
+    arena->last = NULL;
+}
+
+void arena_destroy(struct arena *arena)
+{
+    struct arena_block *block = arena->first;
+    while (block != NULL)
+    {
+        struct arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(arena);
+}
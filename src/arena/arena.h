@@ -0,0 +1,77 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE 4096 // Usable size of a default block
+#define ARENA_ALIGN 16 // Every allocation is aligned on this many bytes
+
+struct arena_block
+{
+    struct arena_block *next;
+    size_t size; // Usable bytes after the header
+    size_t used;
+};
+
+/*
+** A bump allocator: allocations are carved out of big blocks and are never
+** freed one by one. arena_reset releases all of them at once, and keeps the
+** blocks to be filled again.
+*/
+struct arena
+{
+    struct arena_block *first;
+    struct arena_block *current; // The block allocations are carved from
+    char *last; // The last allocation, which can grow in place
+};
+
+/*
+** A position in an arena: what was allocated after it can be released while
+** the allocations before it are kept, as with a stack.
+*/
+struct arena_mark
+{
+    struct arena_block *block;
+    size_t used;
+};
+
+/*
+** \brief Initializes an empty arena, no memory is allocated until needed.
+*/
+void arena_init(struct arena *arena);
+
+/*
+** \brief Returns size zeroed bytes from the arena, NULL on error.
+*/
+void *arena_alloc(struct arena *arena, size_t size);
+
+/*
+** \brief Grows an allocation of the arena from old_size to new_size bytes,
+** in place if it is the last one. The new bytes are zeroed. Returns the new
+** location of the data, NULL on error.
+*/
+void *arena_grow(struct arena *arena, void *ptr, size_t old_size,
+                 size_t new_size);
+
+/*
+** \brief Returns the current position of the arena.
+*/
+struct arena_mark arena_save(const struct arena *arena);
+
+/*
+** \brief Releases the allocations made since mark was saved in O(1), and
+** keeps their blocks to be filled again.
+*/
+void arena_rewind(struct arena *arena, struct arena_mark mark);
+
+/*
+** \brief Releases every allocation of the arena in O(1).
+*/
+void arena_reset(struct arena *arena);
+
+/*
+** \brief Frees the memory of the arena, which may be initialized again.
+*/
+void arena_destroy(struct arena *arena);
+
+#endif /* !ARENA_H */
@@ -4,111 +4,224 @@
 
 #include <string.h>
 
-#include "../functions/hash_functions.h"
+#include "arena/arena.h"
+
+// Where the nodes being parsed are allocated, the heap if NULL
+static struct arena *ast_arena = NULL;
+
+struct arena *ast_set_arena(struct arena *arena)
+{
+    struct arena *previous = ast_arena;
+    ast_arena = arena;
+    return previous;
+}
+
+char *ast_strndup(const char *str, size_t len)
+{
+    if (ast_arena == NULL)
+        return strndup(str, len);
+
+    char *copy = arena_alloc(ast_arena, len + 1);
+    if (copy == NULL)
+        return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void ast_free_value(char *value)
+{
+    if (ast_arena == NULL)
+        free(value);
+}
+
+char *ast_new_value(struct ast *ast, size_t len)
+{
+    char *value;
+    if (!(ast->flags & AST_IN_ARENA))
+        value = malloc(len + 1);
+    else if (ast_arena != NULL)
+        value = arena_alloc(ast_arena, len + 1);
+    else
+        value = NULL;
+    if (value == NULL)
+        return NULL;
+
+    //? A value in an arena is released with it
+    if (!(ast->flags & AST_IN_ARENA))
+        free(ast->value);
+    value[len] = '\0';
+    ast->value = value;
+    return value;
+}
 
 struct ast *ast_new(enum ast_type type, char *value)
 {
-    struct ast *new = calloc(1, sizeof(struct ast));
+    struct ast *new = ast_arena == NULL
+        ? calloc(1, sizeof(struct ast))
+        : arena_alloc(ast_arena, sizeof(struct ast));
     if (!new)
         return NULL;
     new->type = type;
+    new->flags = ast_arena != NULL ? AST_IN_ARENA : 0;
     new->value = value;
     return new;
 }
 
 void ast_free(struct ast *ast)
 {
-    if (ast == NULL)
+    //? The whole tree is released with its arena
+    if (ast == NULL || (ast->flags & AST_IN_ARENA))
         return;
-    else if (ast->type == AST_FUNCDEC)
-    {
-        struct function *f = hash_function_get(ast->value);
-        if (f != NULL && f->value == ast_get_son(ast, 0))
-        {
-            // we do not want to free a registered function name nor its ast
-            ast_free(ast->right_brother);
-            // free(ast->value);
-            free(ast);
-            return;
-        }
-        // otherwise, the function body has not been registered, we can free it
-    }
 
-    if (ast->value != NULL)
-    {
-        free(ast->value);
-    }
-    ast_free(ast->left_son);
-    ast_free(ast->right_brother);
+    free(ast->value);
+    for (size_t i = 0; i < ast->nb_sons; ++i)
+        ast_free(ast->sons[i]);
+    free(ast->sons);
     free(ast);
 }
 
-void expand(struct ast *ast)
+/*
+** Arrays of sons always have a power of two capacity, at least AST_MIN_SONS:
+** it is known from their number of sons, and is full when it is one.
+*/
+static size_t sons_capacity(size_t nb_sons)
 {
-    if (ast == NULL || ast->type != AST_EXPANSION)
-        return;
+    size_t capacity = AST_MIN_SONS;
+    while (capacity < nb_sons)
+        capacity *= 2;
+    return capacity;
+}
 
-    struct ast *head = ast->left_son;
-    for (size_t i = 0; i < ast->nb_sons; ++i)
-    {
-        char *word = head->value;
-        if (head->type == AST_EXPARG_DQ)
-            word = handle_expension(word);
+static int sons_full(size_t nb_sons)
+{
+    return nb_sons == 0
+        || (nb_sons >= AST_MIN_SONS && (nb_sons & (nb_sons - 1)) == 0);
+}
 
-        ssize_t s = ast->value == NULL ? 0 : strlen(ast->value);
-        ast->value = realloc(ast->value, s + strlen(word) + 1);
-        ast->value[s] = '\0';
-        strcat(ast->value, word);
+// Makes room for one more son
+static int sons_grow(struct ast *ast)
+{
+    if (!sons_full(ast->nb_sons))
+        return 1;
 
-        if (head->type == AST_EXPARG_DQ)
-            free(word);
+    size_t size = ast->nb_sons * sizeof(struct ast *);
+    size_t new_size = sons_capacity(ast->nb_sons + 1) * sizeof(struct ast *);
+    struct ast **sons;
+    if (!(ast->flags & AST_IN_ARENA))
+        sons = realloc(ast->sons, new_size);
+    else if (ast_arena != NULL)
+        sons = ast->nb_sons == 0 ? arena_alloc(ast_arena, new_size)
+                                 : arena_grow(ast_arena, ast->sons, size,
+                                              new_size);
+    else
+        sons = NULL;
 
-        if (head->right_brother == NULL)
-            break;
-        head = head->right_brother;
+    if (sons == NULL)
+    {
+        fprintf(stderr, "sons_grow: allocation failed\n");
+        return 0;
     }
+    ast->sons = sons;
+    return 1;
 }
 
-struct ast *ast_get_son(struct ast *ast, size_t index)
+static struct ast *ast_copy_heap(const struct ast *ast)
 {
-    if (index >= ast->nb_sons)
+    char *value = NULL;
+    if (ast->value != NULL && (value = strdup(ast->value)) == NULL)
         return NULL;
 
-    struct ast *nth_son = ast->left_son;
-
-    while (nth_son && index != 0)
+    struct ast *copy = ast_new(ast->type, value);
+    if (copy == NULL)
     {
-        nth_son = nth_son->right_brother;
-        --index;
+        free(value);
+        return NULL;
     }
+    copy->ionumber = ast->ionumber;
+    copy->flags |= ast->flags & AST_LITERAL;
+    copy->builtin = ast->builtin;
+    if (ast->nb_sons == 0)
+        return copy;
 
-    //? Expand double-quoted arguments
-    if (nth_son && nth_son->type == AST_EXPANSION)
+    copy->sons = malloc(sons_capacity(ast->nb_sons) * sizeof(struct ast *));
+    if (copy->sons == NULL)
     {
-        if (nth_son->value)
-            free(nth_son->value);
-        nth_son->value = NULL;
-        expand(nth_son);
+        ast_free(copy);
+        return NULL;
+    }
+    for (; copy->nb_sons < ast->nb_sons; ++copy->nb_sons)
+    {
+        struct ast *son = ast_copy_heap(ast->sons[copy->nb_sons]);
+        if (son == NULL)
+        {
+            ast_free(copy);
+            return NULL;
+        }
+        copy->sons[copy->nb_sons] = son;
     }
-    return nth_son;
+
+    return copy;
 }
 
-struct ast *ast_insert_son(struct ast *ast, size_t index, struct ast *new_son)
+struct ast *ast_copy(const struct ast *ast)
+{
+    struct arena *arena = ast_set_arena(NULL);
+    struct ast *copy = ast_copy_heap(ast);
+    ast_set_arena(arena);
+    return copy;
+}
+
+char *ast_expand(struct arena *scratch, const struct ast *ast)
 {
-    if (index == 0)
+    if (ast->type != AST_EXPANSION || (ast->flags & AST_LITERAL))
+        return ast->value;
+
+    size_t len = 0;
+    size_t size = AST_EXPAND_SIZE;
+    char *word = arena_alloc(scratch, size);
+    for (size_t i = 0; word != NULL && i < ast->nb_sons; ++i)
     {
-        new_son->right_brother = ast->left_son;
-        ast->left_son = new_son;
-        ++ast->nb_sons;
-        return new_son;
+        const struct ast *part = ast->sons[i];
+        char *expanded = NULL;
+        const char *text = part->value;
+        if (part->type == AST_EXPARG_DQ)
+            text = expanded = handle_expension(part->value);
+        if (text == NULL)
+            text = "";
+
+        size_t n = strlen(text);
+        if (len + n + 1 > size)
+        {
+            size_t new_size = 2 * size < len + n + 1 ? len + n + 1 : 2 * size;
+            word = arena_grow(scratch, word, size, new_size);
+            size = new_size;
+        }
+        if (word != NULL)
+            memcpy(word + len, text, n + 1);
+        len += n;
+        free(expanded);
     }
 
-    struct ast *left_brother = ast_get_son(ast, index - 1);
-    if (!left_brother)
+    return word;
+}
+
+struct ast *ast_get_son(const struct ast *ast, size_t index)
+{
+    if (index >= ast->nb_sons)
         return NULL;
 
-    new_son->right_brother = left_brother->right_brother;
-    left_brother->right_brother = new_son;
+    return ast->sons[index];
+}
+
+struct ast *ast_insert_son(struct ast *ast, size_t index, struct ast *new_son)
+{
+    if (index > ast->nb_sons || !sons_grow(ast))
+        return NULL;
+
+    memmove(ast->sons + index + 1, ast->sons + index,
+            (ast->nb_sons - index) * sizeof(struct ast *));
+    ast->sons[index] = new_son;
     ++ast->nb_sons;
     return new_son;
 }
@@ -138,9 +251,14 @@ static char *array_ast_type_string[] = {
     [AST_REDIR_DUP_IN] = "REDIR_DUP_IN",
     [AST_REDIR_DUP_OUT] = "REDIR_DUP_OUT",
     [AST_REDIR_RW] = "REDIR_RW",
+    [AST_REDIR_HEREDOC] = "REDIR_HEREDOC",
+    [AST_REDIR_HEREDOC_QUOTED] = "REDIR_HEREDOC_QUOTED",
+    [AST_INVALID] = "INVALID",
     [AST_FUNCTION] = "FUNCTION",
     [AST_VARIABLE] = "VARIABLE",
     [AST_EXPANSION] = "EXPANSION",
+    [AST_EXPARG_NORM] = "EXPARG_NORM",
+    [AST_EXPARG_DQ] = "EXPARG_DQ",
     [AST_SUBSHELL] = "SUBSHELL",
     [AST_FUNCDEC] = "FUNCDEC",
 };
@@ -150,7 +268,43 @@ char *ast_type_string(enum ast_type type)
     return array_ast_type_string[type];
 }
 
+// Prints a value quoted, on a single line
+static void print_value(const char *value)
+{
+    putchar('\'');
+    for (; *value != '\0'; ++value)
+    {
+        if (*value == '\n')
+            fputs("\\n", stdout);
+        else if (*value == '\t')
+            fputs("\\t", stdout);
+        else if (*value == '\'' || *value == '\\')
+            printf("\\%c", *value);
+        else
+            putchar(*value);
+    }
+    putchar('\'');
+}
+
 void ast_print(const struct ast *ast, int level)
 {
-    printf("%i\n", (ast == NULL) + level);
+    printf("%*s", 2 * level, "");
+    if (ast == NULL)
+    {
+        puts("(null)");
+        return;
+    }
+
+    fputs(ast_type_string(ast->type), stdout);
+    if (ast->type >= AST_REDIR_IN && ast->type <= AST_REDIR_HEREDOC_QUOTED)
+        printf(" %d", ast->ionumber);
+    if (ast->value != NULL)
+    {
+        putchar(' ');
+        print_value(ast->value);
+    }
+    putchar('\n');
+
+    for (size_t i = 0; i < ast->nb_sons; ++i)
+        ast_print(ast->sons[i], level + 1);
 }
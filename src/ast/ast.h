@@ -6,6 +6,9 @@
 
 #include "../lexer/expansion.h"
 
+struct arena;
+struct builtin;
+
 enum ast_type
 {
     AST_COMMAND, // For individual commands
@@ -29,6 +32,8 @@ enum ast_type
     AST_REDIR_DUP_IN, // For '<&' redirections
     AST_REDIR_DUP_OUT, // For '>&' redirections
     AST_REDIR_RW, // For '<>' redirections
+    AST_REDIR_HEREDOC, // For '<<' '<<-' redirections, body is expanded
+    AST_REDIR_HEREDOC_QUOTED, // For '<<' '<<-' with a quoted delimiter
     AST_INVALID,
 
     AST_FUNCTION, // For function definitions
@@ -40,47 +45,109 @@ enum ast_type
     AST_FUNCDEC, // For function declaration
 };
 
+#define AST_MIN_SONS 4 // Smallest capacity of the array of sons
+#define AST_EXPAND_SIZE 64 // Bytes first given to an expanded word
+
+#define AST_IN_ARENA 0x1 // Node, value and sons are carved out of an arena
+#define AST_LITERAL 0x2 // A word whose value is the same once expanded
+
 struct ast
 {
     enum ast_type type; ///< The kind of node we're dealing with
+    int ionumber; ///< File descriptor a redirection applies to
     char *value; ///< String from which node is derived from
-    struct ast *left_son; ///< First son of node, starting from the left
-    struct ast *right_brother; ///< Right brother of node
+    struct ast **sons; ///< Sons of node, from left to right
     size_t nb_sons; ///< Number of sons
+    unsigned char flags; ///< AST_IN_ARENA, AST_LITERAL
+    const struct builtin *builtin; ///< What a command runs if not NULL, set
+                                   ///< by ast_resolve
 };
 
+/**
+ ** \brief Makes ast_new and ast_strndup allocate from the given arena, or
+ ** from the heap if it is NULL, and returns the previous one. The nodes of an
+ ** arena and their values are released at once by resetting it: ast_free
+ ** does nothing on them.
+ */
+struct arena *ast_set_arena(struct arena *arena);
+
+/**
+ ** \brief Copies len bytes of str to be the value of a node. NULL if error.
+ */
+char *ast_strndup(const char *str, size_t len);
+
+/**
+ ** \brief Frees a value from ast_strndup that no node was given.
+ */
+void ast_free_value(char *value);
+
+/**
+ ** \brief Replaces the value of ast by a new one of len bytes and a
+ ** terminator, to be filled. It is allocated as the node was: from the arena
+ ** set with ast_set_arena, which must be its own, or from the heap. NULL if
+ ** error, the value is then left as it was.
+ */
+char *ast_new_value(struct ast *ast, size_t len);
+
 /**
  ** \brief Allocate a new ast with the given type
  */
 struct ast *ast_new(enum ast_type type, char *value);
 
 /**
- ** \brief Recursively free the given ast
+ ** \brief Recursively free the given ast, unless it is in an arena
  */
 void ast_free(struct ast *ast);
 
+/**
+ ** \brief Returns a copy of the given ast and of its sons on the heap. NULL if
+ ** error.
+ */
+struct ast *ast_copy(const struct ast *ast);
+
 /**
  ** \brief Get son at specified index. Indexes start at 0. NULL if error.
+ ** The tree is not modified, it can be shared while it runs.
  */
-struct ast *ast_get_son(struct ast *ast, size_t index);
+struct ast *ast_get_son(const struct ast *ast, size_t index);
+
+/**
+ ** \brief Returns the word an argument or an expansion stands for when it
+ ** runs. The value of a literal is returned as is, an expansion is computed
+ ** in the scratch arena, where it lives until the arena is rewound. NULL if
+ ** error.
+ */
+char *ast_expand(struct arena *scratch, const struct ast *ast);
 
 /**
  ** \brief Insert son at specified index. Indexes start at 0. NULL if error.
+ ** The sons of an ast in an arena are allocated from the arena set with
+ ** ast_set_arena, which must be its own.
  */
 struct ast *ast_insert_son(struct ast *ast, size_t index, struct ast *new_son);
 
 /**
- ** \brief Append son at the end of the other sons. NULL if error.
+ ** \brief Append son at the end of the other sons, in amortized O(1). NULL if
+ ** error.
  */
 struct ast *ast_append_son(struct ast *ast, struct ast *new_son);
 
+/**
+ ** \brief Resolves what can be known of a parsed ast before it runs: words
+ ** without anything to expand are tagged AST_LITERAL, and commands get the
+ ** builtin registered under their name. Must be called with the arena the
+ ** ast was parsed in, once the builtins are registered.
+ */
+void ast_resolve(struct ast *ast);
+
 /**
  ** \brief gets a string corresponding to the ast type.
  */
 char *ast_type_string(enum ast_type type);
 
 /**
- ** \brief Print the ast
+ ** \brief Prints the ast on stdout, a node per line indented by its level:
+ ** its type, the fd of a redirection and its value quoted.
  */
 void ast_print(const struct ast *node, int level);
 
@@ -0,0 +1,268 @@
+#include <stdarg.h>
+#include <string.h>
+
+#include "ast_vm.h"
+
+#define BYTECODE_MIN_SIZE 64 // Words first given to the code
+
+/*
+** The operands of each instruction, and which of them is a jump target (0 if
+** none). Targets are emitted as labels and become offsets once all is placed.
+*/
+static const struct
+{
+    size_t nb_operands;
+    size_t target;
+} opcodes[] = {
+    [OP_EXEC] = { 2, 2 },       [OP_LOAD] = { 1, 0 },
+    [OP_STATUS] = { 0, 0 },     [OP_JUMP] = { 1, 1 },
+    [OP_JUMP_ZERO] = { 1, 1 },  [OP_JUMP_NONZERO] = { 1, 1 },
+    [OP_NOT] = { 0, 0 },        [OP_LOOP_ENTER] = { 1, 0 },
+    [OP_FOR_NEXT] = { 3, 3 },   [OP_LOOP_BODY] = { 3, 3 },
+    [OP_LOOP_LEAVE] = { 2, 2 }, [OP_RETURN] = { 0, 0 },
+};
+
+struct compiler
+{
+    struct bytecode *bc;
+    size_t *labels; // Where each label was placed in the code
+    size_t nb_labels;
+    size_t labels_capacity;
+};
+
+static int grow(void **array, size_t *capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity)
+        return 1;
+
+    size_t new_capacity = *capacity ? *capacity : BYTECODE_MIN_SIZE;
+    while (new_capacity < needed)
+        new_capacity *= 2;
+    void *new_array = realloc(*array, new_capacity * size);
+    if (new_array == NULL)
+        return 0;
+    *array = new_array;
+    *capacity = new_capacity;
+    return 1;
+}
+
+// Appends an instruction, its operands are the following arguments
+static int emit(struct compiler *c, enum opcode op, ...)
+{
+    struct bytecode *bc = c->bc;
+    size_t nb_words = 1 + opcodes[op].nb_operands;
+    if (!grow((void **)&bc->code, &bc->capacity, bc->size + nb_words,
+              sizeof(int)))
+        return 0;
+
+    bc->code[bc->size++] = op;
+    va_list operands;
+    va_start(operands, op);
+    for (size_t i = 0; i < opcodes[op].nb_operands; ++i)
+        bc->code[bc->size++] = va_arg(operands, int);
+    va_end(operands);
+    return 1;
+}
+
+// Returns the index of a node in the table of the code, -1 if error
+static int node_index(struct compiler *c, struct ast *ast)
+{
+    struct bytecode *bc = c->bc;
+    if (!grow((void **)&bc->nodes, &bc->nodes_capacity, bc->nb_nodes + 1,
+              sizeof(struct ast *)))
+        return -1;
+
+    bc->nodes[bc->nb_nodes] = ast;
+    return bc->nb_nodes++;
+}
+
+// A label to jump to, placed later on. -1 if error
+static int label_new(struct compiler *c)
+{
+    if (!grow((void **)&c->labels, &c->labels_capacity, c->nb_labels + 1,
+              sizeof(size_t)))
+        return -1;
+
+    c->labels[c->nb_labels] = 0;
+    return c->nb_labels++;
+}
+
+static void label_place(struct compiler *c, int label)
+{
+    c->labels[label] = c->bc->size;
+}
+
+static int compile(struct compiler *c, struct ast *ast, int unwind,
+                   size_t depth);
+
+static int compile_list(struct compiler *c, struct ast *ast, int unwind,
+                        size_t depth)
+{
+    if (ast->nb_sons == 0 && !emit(c, OP_LOAD, 0))
+        return 0;
+    for (size_t i = 0; i < ast->nb_sons; ++i)
+        if (!compile(c, ast->sons[i], unwind, depth))
+            return 0;
+    return emit(c, OP_STATUS);
+}
+
+static int compile_conditional(struct compiler *c, struct ast *ast,
+                               int unwind, size_t depth)
+{
+    int label_else = label_new(c);
+    int label_end = label_new(c);
+    if (label_else == -1 || label_end == -1
+        || !compile(c, ast_get_son(ast, 0), unwind, depth)
+        || !emit(c, OP_JUMP_NONZERO, label_else)
+        || !compile(c, ast_get_son(ast, 1), unwind, depth)
+        || !emit(c, OP_JUMP, label_end))
+        return 0;
+
+    // An if without else returns 0 when its condition is false
+    label_place(c, label_else);
+    if (!compile(c, ast_get_son(ast, 2), unwind, depth))
+        return 0;
+    label_place(c, label_end);
+    return emit(c, OP_STATUS);
+}
+
+// && and ||: the right side runs if the left one returned 0, or did not
+static int compile_and_or(struct compiler *c, struct ast *ast, int unwind,
+                          size_t depth)
+{
+    int label_end = label_new(c);
+    enum opcode skip = ast->type == AST_AND ? OP_JUMP_NONZERO : OP_JUMP_ZERO;
+    if (label_end == -1 || !compile(c, ast_get_son(ast, 0), unwind, depth)
+        || !emit(c, skip, label_end)
+        || !compile(c, ast_get_son(ast, 1), unwind, depth))
+        return 0;
+
+    label_place(c, label_end);
+    return emit(c, OP_STATUS);
+}
+
+/*
+** while and until loop back to their condition, for to its next word. An
+** error in the condition ends the loop, one in the body is handed to
+** OP_LOOP_BODY, as a break or a continue would be.
+*/
+static int compile_loop(struct compiler *c, struct ast *ast, int unwind,
+                        size_t depth)
+{
+    int slot = depth;
+    int label_next = label_new(c);
+    int label_body_end = label_new(c);
+    int label_exit = label_new(c);
+    int node = ast->type == AST_FOR ? node_index(c, ast) : -1;
+    if (label_next == -1 || label_body_end == -1 || label_exit == -1
+        || (ast->type == AST_FOR && node == -1)
+        || !emit(c, OP_LOOP_ENTER, slot))
+        return 0;
+    if (depth + 1 > c->bc->nb_slots)
+        c->bc->nb_slots = depth + 1;
+
+    label_place(c, label_next);
+    if (ast->type == AST_FOR)
+    {
+        if (!emit(c, OP_FOR_NEXT, slot, node, label_exit))
+            return 0;
+    }
+    else
+    {
+        enum opcode skip = ast->type == AST_WHILE ? OP_JUMP_NONZERO
+                                                  : OP_JUMP_ZERO;
+        if (!compile(c, ast_get_son(ast, 0), label_exit, depth + 1)
+            || !emit(c, skip, label_exit))
+            return 0;
+    }
+
+    if (!compile(c, ast_get_son(ast, 1), label_body_end, depth + 1))
+        return 0;
+    label_place(c, label_body_end);
+    if (!emit(c, OP_LOOP_BODY, slot, node, label_exit)
+        || !emit(c, OP_JUMP, label_next))
+        return 0;
+
+    label_place(c, label_exit);
+    return emit(c, OP_LOOP_LEAVE, slot, unwind);
+}
+
+static int compile_not(struct compiler *c, struct ast *ast, int unwind,
+                       size_t depth)
+{
+    return compile(c, ast_get_son(ast, 0), unwind, depth) && emit(c, OP_NOT)
+        && emit(c, OP_STATUS);
+}
+
+/*
+** Emits the code of ast, which jumps to unwind if it returns an error. depth
+** is the number of loops around it, the slot of the next loop.
+*/
+static int compile(struct compiler *c, struct ast *ast, int unwind,
+                   size_t depth)
+{
+    //? ast_exec(NULL) returns 0 without setting $?
+    if (ast == NULL)
+        return emit(c, OP_LOAD, 0);
+
+    switch (ast->type)
+    {
+    case AST_COMMAND_LIST:
+        return compile_list(c, ast, unwind, depth);
+    case AST_CONDITIONAL:
+        return compile_conditional(c, ast, unwind, depth);
+    case AST_AND:
+    case AST_OR:
+        return compile_and_or(c, ast, unwind, depth);
+    case AST_WHILE:
+    case AST_UNTIL:
+    case AST_FOR:
+        return compile_loop(c, ast, unwind, depth);
+    case AST_NOT:
+        return compile_not(c, ast, unwind, depth);
+    default: {
+        int node = node_index(c, ast);
+        return node != -1 && emit(c, OP_EXEC, node, unwind);
+    }
+    }
+}
+
+// Replaces the labels jumped to by their place in the code
+static void resolve_labels(struct compiler *c)
+{
+    struct bytecode *bc = c->bc;
+    for (size_t i = 0; i < bc->size; i += 1 + opcodes[bc->code[i]].nb_operands)
+    {
+        size_t target = opcodes[bc->code[i]].target;
+        if (target != 0)
+            bc->code[i + target] = c->labels[bc->code[i + target]];
+    }
+}
+
+int ast_compile(struct bytecode *bc, struct ast *ast)
+{
+    memset(bc, 0, sizeof(struct bytecode));
+    struct compiler c = { .bc = bc };
+
+    int label_return = label_new(&c);
+    int ok = label_return != -1 && compile(&c, ast, label_return, 0);
+    if (ok)
+    {
+        label_place(&c, label_return);
+        ok = emit(&c, OP_RETURN);
+    }
+    if (ok)
+        resolve_labels(&c);
+    else
+        bytecode_free(bc);
+
+    free(c.labels);
+    return ok;
+}
+
+void bytecode_free(struct bytecode *bc)
+{
+    free(bc->code);
+    free(bc->nodes);
+    memset(bc, 0, sizeof(struct bytecode));
+}
@@ -1,17 +1,24 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // memfd_create
 
 #include "ast_exec.h"
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "../IO_Backend/scan.h"
+#include "../arena/arena.h"
+#include "../builtins/builtins.h"
 #include "../exit_codes.h"
 #include "../lexer/lexer.h"
 #include "../parser/parser.h"
+#include "../path/path_cache.h"
 #include "../variables/shell_variables.h"
 
 // ==================================================================
@@ -22,22 +29,32 @@
 //  1 and anything >0 signifies external error
 // ==================================================================
 
-int ast_exec_dot(struct ast *ast);
-static int ast_exec_export(struct ast *ast);
-int ast_exec_cd(struct ast *ast);
+int ast_exec_dot(int argc, char **argv);
+static int ast_exec_export(int argc, char **argv);
+int ast_exec_cd(int argc, char **argv);
 
-static int ast_exec_redir_in(struct ast *ast, struct ast *redir);
-static int ast_exec_redir_out(struct ast *ast, struct ast *redir);
-static int ast_exec_redir_app_out(struct ast *ast, struct ast *redir);
-static int ast_exec_redir_dup_in(struct ast *ast, struct ast *redir);
-static int ast_exec_redir_dup_out(struct ast *ast, struct ast *redir);
-static int ast_exec_redir_rw(struct ast *ast, struct ast *redir);
+static int ast_exec_redir_in(struct ast *ast, size_t index);
+static int ast_exec_redir_out(struct ast *ast, size_t index);
+static int ast_exec_redir_app_out(struct ast *ast, size_t index);
+static int ast_exec_redir_dup_in(struct ast *ast, size_t index);
+static int ast_exec_redir_dup_out(struct ast *ast, size_t index);
+static int ast_exec_redir_rw(struct ast *ast, size_t index);
+static int ast_exec_redir_heredoc(struct ast *ast, size_t index);
 
 // This will help ensure forked processes don't interact with the main process.
 static int current_is_a_fork = 0;
 static size_t number_of_loops = 0;
 static size_t number_of_breaks = 0;
 static size_t number_of_continues = 0;
+// Holds what commands expand while they run, as a stack
+static struct arena scratch;
+
+/*
+** The code $? was last set to, and its text. Most nodes end with the code $?
+** already holds, which is then not set again.
+*/
+static int status_code;
+static char *status_text = NULL;
 
 int current_42sh_is_a_fork(void)
 {
@@ -49,6 +66,7 @@ static void print_with_escapes(char *string, int escape)
     if (!string)
         return;
 
+    char *end = string + strlen(string);
     while (*string)
     {
         if (escape && *string == '\\')
@@ -75,9 +93,13 @@ static void print_with_escapes(char *string, int escape)
                 }
             }
         }
-        else
+        else //$ Print everything up to the next escape at once
         {
-            putchar(*string);
+            size_t run = escape ? scan_until(string, end - string, "\\", 1)
+                                : (size_t)(end - string);
+            fwrite(string, 1, run, stdout);
+            string += run;
+            continue;
         }
         if (*string)
         {
@@ -98,17 +120,16 @@ static int unset_fun(char *name)
     return 0;
 }
 
-static int ast_exec_echo(struct ast *ast)
+static int ast_exec_echo(int argc, char **argv)
 {
     int newline = 1; // echo prints a newline at the end
     int backslash_escapes = 0; // backslash escapes are not interpreted
-    size_t start_index = 0; // Initialize the start index
+    int start_index = 1; // Initialize the start index
 
     // Parse options
-    for (; start_index < ast->nb_sons; ++start_index)
+    for (; start_index < argc; ++start_index)
     {
-        struct ast *son = ast_get_son(ast, start_index);
-        char *arg = son->value;
+        char *arg = argv[start_index];
 
         if (arg[0] != '-')
         {
@@ -144,13 +165,12 @@ static int ast_exec_echo(struct ast *ast)
         }
     }
     // Print arguments after options
-    for (size_t i = start_index; i < ast->nb_sons; ++i)
+    for (int i = start_index; i < argc; ++i)
     {
         if (i > start_index)
             printf(" "); // Print spaces between arguments
 
-        struct ast *son = ast_get_son(ast, i);
-        char *string = son->value;
+        char *string = argv[i];
 
         // Print with or without backslash escapes based on the option
         print_with_escapes(string, backslash_escapes);
@@ -158,44 +178,59 @@ static int ast_exec_echo(struct ast *ast)
 
     if (newline)
         putchar('\n');
+    fflush(NULL);
+    return 0;
+}
+
+static int ast_exec_true(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
     return 0;
 }
 
-static int ast_exec_break(struct ast *ast)
+static int ast_exec_false(int argc, char **argv)
 {
-    if (ast->nb_sons > 1)
+    (void)argc;
+    (void)argv;
+    return 1;
+}
+
+static int ast_exec_break(int argc, char **argv)
+{
+    if (argc > 2)
     {
-        fprintf(stderr, "ast_exec_break: Wrong number of sons (%zu).\n",
-                ast->nb_sons);
+        fprintf(stderr, "ast_exec_break: Wrong number of sons (%d).\n",
+                argc - 1);
         return EC_UNKNOWN;
     }
-    int nb_breaks = ast->nb_sons == 0 ? 1 : atoi(ast_get_son(ast, 0)->value);
+    int nb_breaks = argc == 1 ? 1 : atoi(argv[1]);
     number_of_breaks += nb_breaks;
     return EC_BREAK;
 }
 
-static int ast_exec_continue(struct ast *ast)
+static int ast_exec_continue(int argc, char **argv)
 {
-    if (ast->nb_sons > 1)
+    if (argc > 2)
     {
-        fprintf(stderr, "ast_exec_continue: Wrong number of sons (%zu).\n",
-                ast->nb_sons);
+        fprintf(stderr, "ast_exec_continue: Wrong number of sons (%d).\n",
+                argc - 1);
         return EC_UNKNOWN;
     }
-    int nb_continues = ast->nb_sons == 0 ? 1 : atoi(ast_get_son(ast, 0)->value);
+    int nb_continues = argc == 1 ? 1 : atoi(argv[1]);
     number_of_continues += nb_continues;
     return EC_CONTINUE;
 }
 
-static int ast_exec_exit(struct ast *ast)
+static int ast_exec_exit(int argc, char **argv)
 {
-    if (ast->nb_sons > 1)
+    if (argc > 2)
     {
         return EC_EXIT_MIN;
     }
     int exit_code = 0;
-    if (ast->nb_sons == 1)
-        exit_code = atoi(ast_get_son(ast, 0)->value);
+    if (argc == 2)
+        exit_code = atoi(argv[1]);
     else
     {
         struct variable *v = hash_variable_get("?");
@@ -215,40 +250,33 @@ static int ast_exec_function(struct ast *ast, struct function *func)
 
 /*
  * Executes a non-builtin program.
- * It uses a fork + execvp method.
+ * It uses a fork + execv of where it was found in PATH, which is searched
+ * once per command name by the path cache (see path_cache.h).
  */
-int ast_exec_program(struct ast *ast)
+int ast_exec_program(int argc, char **argv)
 {
-    // (1) get all arguments (2) fork and execvp
-    // get all arguments
-    size_t argc = ast->nb_sons;
-    char **argv = calloc(sizeof(char *), argc + 2);
-    if (!argv)
-    {
-        fprintf(stderr, "ast_exec_program: Memory error.\n");
-        return EC_MEMORY;
-    }
-    argv[0] = ast->value;
-    for (size_t i = 0; i < argc; ++i)
-    {
-        struct ast *son = ast_get_son(ast, i);
-        argv[i + 1] = son->value;
-    }
+    // argv is NULL terminated, as execvp wants it
+    (void)argc;
+
+    const char *path = NULL;
+    enum path_status found = path_cache_lookup(argv[0], &path);
 
     // fork and execvp
     int pid = fork();
     if (pid == -1)
     {
         fprintf(stderr, "ast_exec_program: Problem with fork.\n");
-        free(argv);
         return EC_UNKNOWN;
     }
     else if (pid == 0)
     {
         current_is_a_fork = 1;
-        if (execvp(argv[0], argv) == -1)
-            fprintf(stderr, "ast_exec_program: Problem with execvp.\n");
-        free(argv);
+        //? If it cannot run from there (a script without #! for one),
+        //? execvp searches it again and knows what to do with it
+        if (found != PATH_NOT_FOUND
+            && (found == PATH_UNKNOWN || execv(path, argv) == -1))
+            execvp(argv[0], argv);
+        fprintf(stderr, "ast_exec_program: Problem with execvp.\n");
         return EC_COMMAND_NOT_FOUND;
     }
     int wait_status;
@@ -256,66 +284,111 @@ int ast_exec_program(struct ast *ast)
     if (!WIFEXITED(wait_status))
     {
         fprintf(stderr, "ast_exec_program: Child did not terminate smoothly.");
-        free(argv);
         return EC_UNKNOWN;
     }
-    free(argv);
     return WEXITSTATUS(wait_status);
 }
 
-static int ast_exec_special_command(struct ast *ast)
+/*
+** hash [-r] [name...]: remembers where each name is found in PATH, or prints
+** what is remembered. -r forgets it all.
+*/
+static int ast_exec_hash(int argc, char **argv)
 {
-    if (strcmp(ast->value, "true") == 0)
-    {
-        return 0;
-    }
-    else if (strcmp(ast->value, "false") == 0)
+    int i = 1;
+    if (argc > 1 && strcmp(argv[1], "-r") == 0)
     {
-        return 1;
+        path_cache_clear();
+        ++i;
     }
-    else if (strcmp(ast->value, "exit") == 0)
-    {
-        return ast_exec_exit(ast);
-    }
-    else if (strcmp(ast->value, "break") == 0)
+    else if (argc == 1 && path_cache_print() == 0)
+        printf("hash: hash table empty\n");
+
+    int return_code = 0;
+    for (; i < argc; ++i)
     {
-        return ast_exec_break(ast);
+        //? Builtins and names with a '/' are not searched, as in bash
+        if (builtin_get(argv[i]) != NULL || strchr(argv[i], '/') != NULL)
+            continue;
+        if (path_cache_add(argv[i], NULL) == PATH_NOT_FOUND)
+        {
+            fprintf(stderr, "hash: %s: not found\n", argv[i]);
+            return_code = 1;
+        }
     }
-    else if (strcmp(ast->value, "continue") == 0)
+    fflush(NULL);
+    return return_code;
+}
+
+// command -v name: prints how name would be run, returns 1 if it would not
+static int command_print(char *name)
+{
+    if (strchr(name, '/') != NULL)
     {
-        return ast_exec_continue(ast);
+        if (access(name, X_OK) != 0)
+            return 1;
+        printf("%s\n", name);
+        return 0;
     }
-    else if (strcmp(ast->value, ".") == 0)
+    if (builtin_get(name) != NULL || hash_function_get(name) != NULL)
     {
-        return ast_exec_dot(ast);
+        printf("%s\n", name);
+        return 0;
     }
-    else if (strcmp(ast->value, "export") == 0)
+
+    const char *path;
+    enum path_status found = path_cache_add(name, &path);
+    if (found == PATH_FOUND)
+        printf("%s\n", path);
+    else if (found == PATH_UNKNOWN)
     {
-        return ast_exec_export(ast);
+        //? Found through a relative directory of PATH, so not remembered
+        char *searched = path_cache_search(name);
+        if (searched == NULL)
+            return 1;
+        printf("%s\n", searched);
+        free(searched);
     }
-    else if (strcmp(ast->value, "cd") == 0)
+    return found == PATH_NOT_FOUND;
+}
+
+/*
+** command [-v] name [arg...]: runs name as a builtin or a program, never as a
+** function. With -v, prints how it would be run instead.
+*/
+static int ast_exec_command_builtin(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "-v") == 0)
     {
-        return ast_exec_cd(ast);
+        int return_code = 0;
+        for (int i = 2; i < argc; ++i)
+            if (command_print(argv[i]) != 0)
+                return_code = 1;
+        fflush(NULL);
+        return return_code;
     }
-    return ast_exec_program(ast);
+    if (argc == 1)
+        return 0;
+
+    const struct builtin *builtin = builtin_get(argv[1]);
+    return builtin != NULL ? builtin->run(argc - 1, argv + 1)
+                           : ast_exec_program(argc - 1, argv + 1);
 }
 
-static int ast_exec_unset(struct ast *ast)
+static int ast_exec_unset(int argc, char **argv)
 {
-    if (ast->nb_sons > 2)
+    if (argc > 3)
     {
         fprintf(stderr,
-                "unset: too many arguments, format: [OPTION] [NAME] (%zu).\n",
-                ast->nb_sons);
+                "unset: too many arguments, format: [OPTION] [NAME] (%d).\n",
+                argc - 1);
         return -1; // Indique une erreur
     }
 
-    if (ast->nb_sons == 2)
+    if (argc == 3)
     {
-        struct ast *option_ast = ast_get_son(ast, 0);
-        char *option = option_ast->value;
-        struct ast *name_ast = ast_get_son(ast, 1);
-        char *name = name_ast->value;
+        char *option = argv[1];
+        char *name = argv[2];
 
         if (strcmp(option, "-v") == 0)
         {
@@ -334,11 +407,9 @@ static int ast_exec_unset(struct ast *ast)
             return -1;
         }
     }
-    else if (ast->nb_sons == 1)
+    else if (argc == 2)
     {
-        struct ast *name_ast = ast_get_son(ast, 0);
-        char *name = name_ast->value;
-        return unset_var(name);
+        return unset_var(argv[1]);
     }
     else
     {
@@ -347,6 +418,25 @@ static int ast_exec_unset(struct ast *ast)
     }
 }
 
+/*
+** Expands the name and the arguments of a command into a NULL terminated
+** argv, in the scratch area. NULL if error.
+*/
+static char **command_argv(const struct ast *ast, int *argc)
+{
+    char **argv = arena_alloc(&scratch, (ast->nb_sons + 2) * sizeof(char *));
+    if (argv == NULL)
+        return NULL;
+
+    argv[0] = ast->value;
+    for (size_t i = 0; i < ast->nb_sons; ++i)
+        if ((argv[i + 1] = ast_expand(&scratch, ast->sons[i])) == NULL)
+            return NULL;
+
+    *argc = ast->nb_sons + 1;
+    return argv;
+}
+
 /*
  * Executes a list of commands.
  * If the command is a builtin, we have our own function for it.
@@ -354,51 +444,30 @@ static int ast_exec_unset(struct ast *ast)
  */
 static int ast_exec_command(struct ast *ast)
 {
-    int command_result = 0;
-    // Search for a function, functions have priority over built-ins
-    struct function *func = hash_function_get(ast->value);
-    if (func != NULL)
+    // As POSIX has it: special builtins, then functions, then the other
+    // builtins and then programs
+    const struct builtin *builtin = ast->builtin;
+    if (builtin == NULL || !(builtin->flags & BUILTIN_SPECIAL))
     {
-        return ast_exec_function(ast, func);
+        struct function *func = hash_function_get(ast->value);
+        if (func != NULL)
+            return ast_exec_function(ast, func);
     }
-    else if (strcmp(ast->value, "echo") == 0)
-    {
-        struct ast *filter_ast = ast_new(AST_COMMAND, strdup("echo"));
-        if (!filter_ast)
-        {
-            // Handle memory allocation failure
-            return EC_MEMORY;
-        }
 
-        for (size_t i = 0; i < ast->nb_sons; ++i)
-        {
-            struct ast *child = ast_get_son(ast, i);
-            if (child->type == AST_ARGUMENT || child->type == AST_EXPANSION)
-            {
-                struct ast *argument_node =
-                    ast_new(AST_ARGUMENT, strdup(child->value));
-                if (!argument_node)
-                {
-                    // Handle memory allocation failure
-                    ast_free(filter_ast);
-                    return EC_MEMORY;
-                }
-                ast_append_son(filter_ast, argument_node);
-            }
-        }
-        // Execute echo with the filtered arguments
-        command_result = ast_exec_echo(filter_ast);
-        ast_free(filter_ast);
-    }
-    else if (strcmp(ast->value, "unset") == 0)
+    //? The words only live while the command runs
+    struct arena_mark mark = arena_save(&scratch);
+    int argc;
+    char **argv = command_argv(ast, &argc);
+    int command_result;
+    if (argv == NULL)
     {
-        return ast_exec_unset(ast);
+        fprintf(stderr, "ast_exec_command: Memory error.\n");
+        command_result = EC_MEMORY;
     }
     else
-    {
-        return ast_exec_special_command(ast);
-    }
-    fflush(NULL);
+        command_result = builtin != NULL ? builtin->run(argc, argv)
+                                         : ast_exec_program(argc, argv);
+    arena_rewind(&scratch, mark);
     return command_result;
 }
 
@@ -513,15 +582,18 @@ int ast_exec_assignment(struct ast *ast)
         return EC_MEMORY;
     }
     strcpy(var_name, ast->value);
-    struct ast *word_ast = ast_get_son(ast, 0);
-    char *word = malloc(strlen(word_ast->value) + 1);
+    struct arena_mark mark = arena_save(&scratch);
+    char *value = ast_expand(&scratch, ast_get_son(ast, 0));
+    char *word = value == NULL ? NULL : strdup(value);
+    arena_rewind(&scratch, mark);
     if (!word)
     {
         fprintf(stderr, "ast_exec_assignment: Memory error.\n");
         free(var_name);
         return EC_MEMORY;
     }
-    strcpy(word, word_ast->value);
+    if (strcmp(var_name, "PATH") == 0)
+        path_cache_clear();
     struct variable *var = hash_variable_set(var_name, word);
     if (!var)
     {
@@ -569,74 +641,68 @@ static int ast_exec_conditional(struct ast *ast)
     }
 }
 
-static int ast_exec_while(struct ast *ast)
+void ast_exec_loop_enter(void)
 {
     ++number_of_loops;
+}
+
+int ast_exec_loop_body(int *code)
+{
+    if (*code == EC_BREAK && number_of_breaks > 0)
+    {
+        --number_of_breaks;
+        if (number_of_breaks == 0 || number_of_loops == 1)
+            *code = 0; // if we are finished breaking/continuing, we
+                       // can continue execution
+        return 0;
+    }
+    else if (*code == EC_CONTINUE && number_of_continues > 0)
+    {
+        --number_of_continues;
+        if (number_of_continues == 0 || number_of_loops == 1)
+            *code = 0; // if we are finished breaking/continuing, we
+                       // can continue execution
+        // if we have to continue on an enclosing loop,
+        // and if there is an enclosing loop,
+        // then we break out of the current one.
+        return !(number_of_continues > 0 && number_of_loops >= 2);
+    }
+    else if (*code < 0 && *code != EC_BREAK && *code != EC_CONTINUE)
+        return 0;
+    return 1;
+}
+
+void ast_exec_loop_leave(void)
+{
+    --number_of_loops;
+}
+
+static int ast_exec_while(struct ast *ast)
+{
+    ast_exec_loop_enter();
     int inside_code = 0; // if loop never executes, return 0
     while (ast_exec(ast_get_son(ast, 0)) == 0) // while loop condition is true
     {
         inside_code = ast_exec(ast_get_son(ast, 1));
-        if (inside_code == EC_BREAK && number_of_breaks > 0)
-        {
-            --number_of_breaks;
-            if (number_of_breaks == 0 || number_of_loops == 1)
-                inside_code = 0; // if we are finished breaking/continuing, we
-                                 // can continue execution
-            break;
-        }
-        else if (inside_code == EC_CONTINUE && number_of_continues > 0)
-        {
-            --number_of_continues;
-            if (number_of_continues == 0 || number_of_loops == 1)
-                inside_code = 0; // if we are finished breaking/continuing, we
-                                 // can continue execution
-            // if we have to continue on an enclosing loop,
-            // and if there is an enclosing loop,
-            // then we break out of the current one.
-            if (number_of_continues > 0 && number_of_loops >= 2)
-                break;
-        }
-        else if (inside_code < 0 && inside_code != EC_BREAK
-                 && inside_code != EC_CONTINUE)
+        if (!ast_exec_loop_body(&inside_code))
             break;
     }
-    --number_of_loops;
+    ast_exec_loop_leave();
     return inside_code;
 }
 
 static int ast_exec_until(struct ast *ast)
 {
-    ++number_of_loops;
+    ast_exec_loop_enter();
     int inside_code = 0; // if loop never executes, return 0
     while (ast_exec(ast_get_son(ast, 0)) > 0) // while loop condition is false
     // (note that internal errors (<0) still exit the loop)
     {
         inside_code = ast_exec(ast_get_son(ast, 1));
-        if (inside_code == EC_BREAK && number_of_breaks > 0)
-        {
-            --number_of_breaks;
-            if (number_of_breaks == 0 || number_of_loops == 1)
-                inside_code = 0; // if we are finished breaking/continuing, we
-                                 // can continue execution
-            break;
-        }
-        else if (inside_code == EC_CONTINUE && number_of_continues > 0)
-        {
-            --number_of_continues;
-            if (number_of_continues == 0 || number_of_loops == 1)
-                inside_code = 0; // if we are finished breaking/continuing, we
-                                 // can continue execution
-            // if we have to continue on an enclosing loop,
-            // and if there is an enclosing loop,
-            // then we break out of the current one.
-            if (number_of_continues > 0 && number_of_loops >= 2)
-                break;
-        }
-        else if (inside_code < 0 && inside_code != EC_BREAK
-                 && inside_code != EC_CONTINUE)
+        if (!ast_exec_loop_body(&inside_code))
             break;
     }
-    --number_of_loops;
+    ast_exec_loop_leave();
     return inside_code;
 }
 
@@ -673,51 +739,44 @@ static int ast_exec_or(struct ast *ast)
         return ast_exec(ast_get_son(ast, 1));
 }
 
+int ast_exec_for_bind(const char *name, const struct ast *word)
+{
+    //? The word only lives until the environment holds a copy of it
+    struct arena_mark mark = arena_save(&scratch);
+    char *value = ast_expand(&scratch, word);
+    int ok = value != NULL && setenv(name, value, 1) == 0;
+    arena_rewind(&scratch, mark);
+    if (!ok)
+        fprintf(stderr, "ast_exec_for_bind: Memory error.\n");
+    return ok;
+}
+
 static int ast_exec_for(struct ast *ast)
 {
-    ++number_of_loops;
+    ast_exec_loop_enter();
     char *var_name = ast->value;
     struct ast *list = ast_get_son(ast, 0); // First child is the list
     struct ast *compound_list = ast_get_son(ast, 1); // Second child is the body
 
     int inside_code = 0; // if nothing is executed, return 0
     int loop_flag = 1;
-    for (size_t i = 0; i < list->nb_sons && loop_flag; ++i)
+    size_t i = 0;
+    for (; i < list->nb_sons && loop_flag; ++i)
     {
-        struct ast *word_ast = ast_get_son(list, i);
-        char *word = word_ast->value;
-
-        setenv(var_name, word, 1); // Set the loop variable to the current word
-
-        inside_code =
-            ast_exec(compound_list); // Execute the body of the for loop
-        if (inside_code == EC_BREAK && number_of_breaks > 0)
+        // Set the loop variable to the current word, overwriting the last one
+        if (!ast_exec_for_bind(var_name, ast_get_son(list, i)))
         {
-            --number_of_breaks;
-            if (number_of_breaks == 0 || number_of_loops == 1)
-                inside_code = 0; // if we are finished breaking/continuing, we
-                                 // can continue execution
-            loop_flag = 0;
-        }
-        else if (inside_code == EC_CONTINUE && number_of_continues > 0)
-        {
-            --number_of_continues;
-            if (number_of_continues == 0 || number_of_loops == 1)
-                inside_code = 0; // if we are finished breaking/continuing, we
-                                 // can continue execution
-            // if we have to continue on an enclosing loop,
-            // and if there is an enclosing loop,
-            // then we break out of the current one.
-            if (number_of_continues > 0 && number_of_loops >= 2)
-                loop_flag = 0;
+            inside_code = EC_MEMORY;
+            break;
         }
-        else if (inside_code < 0 && inside_code != EC_BREAK
-                 && inside_code != EC_CONTINUE)
-            loop_flag = 0;
 
-        unsetenv(var_name); // Clean env variable after each iteration
+        inside_code =
+            ast_exec(compound_list); // Execute the body of the for loop
+        loop_flag = ast_exec_loop_body(&inside_code);
     }
-    --number_of_loops;
+    if (i > 0)
+        unsetenv(var_name); // Clean env variable once the loop is done
+    ast_exec_loop_leave();
     return inside_code;
 }
 
@@ -752,73 +811,195 @@ static int ast_exec_subshell(struct ast *ast)
     }
 }
 
+// The table owns a copy: the definition may run again, or be freed first
 static int ast_exec_funcdec(struct ast *ast)
 {
-    return hash_function_set(ast->value, ast_get_son(ast, 0)) == NULL
-        ? EC_UNKNOWN
-        : 0;
-    // return hash_function_set(strdup(ast->value), ast_get_son(ast, 0)) == NULL
-    // ? EC_UNKNOWN : 0;
+    char *name = strdup(ast->value);
+    struct ast *body = ast_copy(ast_get_son(ast, 0));
+    if (name == NULL || body == NULL)
+    {
+        free(name);
+        ast_free(body);
+        return EC_UNKNOWN;
+    }
+
+    return hash_function_set(name, body) == NULL ? EC_UNKNOWN : 0;
 }
 
-int ast_exec_dot(struct ast *ast)
+/*
+** The scripts read by the dot builtin, kept parsed: a file sourced in a loop
+** is only parsed again once it changed.
+*/
+struct dot_script
+{
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    struct script script;
+    size_t running; // Nested runs of the script, it cannot be freed meanwhile
+    struct dot_script *next;
+};
+
+static struct dot_script *dot_scripts = NULL;
+
+// Returns the parsed script of the file described by st, parsing it if needed
+static struct dot_script *dot_script_get(char *filename, const struct stat *st)
 {
-    if (ast->nb_sons < 1)
+    struct dot_script **link = &dot_scripts;
+    for (; *link != NULL; link = &(*link)->next)
+        if ((*link)->dev == st->st_dev && (*link)->ino == st->st_ino)
+            break;
+
+    struct dot_script *entry = *link;
+    if (entry != NULL && entry->mtime.tv_sec == st->st_mtim.tv_sec
+        && entry->mtime.tv_nsec == st->st_mtim.tv_nsec)
+        return entry;
+    if (entry != NULL && entry->running > 0)
+        return NULL; // It changed while it runs, it is not memoized anymore
+
+    struct script script = { .asts = NULL };
+    struct IO *input = IO_create(IO_FILE, filename);
+    struct lexer *lexer = input == NULL ? NULL : lexer_new(input);
+    if (lexer == NULL)
     {
-        fprintf(stderr, "Error: No filename provided for the dot command.\n");
-        return -1;
+        IO_free(input);
+        return NULL;
     }
+    int ok = parse_script(&script, lexer);
+    lexer_free(lexer);
+    if (!ok)
+        return NULL;
 
-    char *filename = ast_get_son(ast, 0)->value;
-    if (!filename)
+    if (entry == NULL)
     {
-        fprintf(stderr, "Error: Failed to retrieve filename from AST.\n");
-        return -1;
+        entry = calloc(1, sizeof(struct dot_script));
+        if (entry == NULL)
+        {
+            fprintf(stderr, "dot_script_get: calloc failed\n");
+            script_free(&script);
+            return NULL;
+        }
+        entry->dev = st->st_dev;
+        entry->ino = st->st_ino;
+        *link = entry;
     }
+    else
+        script_free(&entry->script);
+
+    entry->mtime = st->st_mtim;
+    entry->script = script;
+    return entry;
+}
 
-    FILE *file = fopen(filename, "r");
-    if (!file)
+// Runs a script that could not be memoized, parsing it as it goes
+static int dot_run_file(char *filename)
+{
+    struct IO *input = IO_create(IO_FILE, filename);
+    struct lexer *lexer = input == NULL ? NULL : lexer_new(input);
+    if (lexer == NULL)
     {
+        IO_free(input);
         perror("Error opening file");
         return -1;
     }
 
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read;
-    int status = 0;
+    struct arena arena;
+    arena_init(&arena);
 
-    while ((read = getline(&line, &len, file)) != -1)
-    {
-        struct lexer *line_lexer = lexer_new_from_string(line);
-        struct ast *line_ast = NULL;
-
-        if (parse_input(&line_ast, line_lexer) != 0)
+    int status = 0;
+    struct token next = lexer_peek(lexer);
+    while (next.type != TOKEN_EOF && !current_42sh_is_a_fork())
+    {
+        struct ast *ast = NULL;
+        struct arena *previous = ast_set_arena(&arena);
+        enum parser_status parsed = next.type == TOKEN_ERROR
+            ? PARSER_UNEXPECTED_TOKEN
+            : parse_input(&ast, lexer);
+        ast_set_arena(previous);
+        if (parsed != PARSER_OK)
         {
-            fprintf(stderr, "Error parsing line: %s\n", line);
+            fprintf(stderr, "Error parsing %s\n", filename);
             status = -1;
-            lexer_free(line_lexer);
             break;
         }
 
-        status = ast_exec(line_ast);
+        status = ast == NULL ? 0 : ast_exec(ast);
+        ast_free(ast);
+        arena_reset(&arena);
+        if (status != 0)
+        {
+            fprintf(stderr, "Error executing a command of %s\n", filename);
+            break;
+        }
+
+        lexer_release(lexer);
+        next = lexer_peek(lexer);
+    }
+
+    arena_destroy(&arena);
+    lexer_free(lexer);
+    return status;
+}
+
+int ast_exec_dot(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Error: No filename provided for the dot command.\n");
+        return -1;
+    }
+
+    char *filename = argv[1];
+    if (!filename)
+    {
+        fprintf(stderr, "Error: Failed to retrieve filename from AST.\n");
+        return -1;
+    }
+
+    struct stat st;
+    if (stat(filename, &st) == -1)
+    {
+        perror("Error opening file");
+        return -1;
+    }
 
-        ast_free(line_ast);
-        lexer_free(line_lexer);
+    struct dot_script *entry = dot_script_get(filename, &st);
+    if (entry == NULL)
+        return dot_run_file(filename);
 
+    int status = 0;
+    entry->running++;
+    for (size_t i = 0; i < entry->script.nb_asts && !current_42sh_is_a_fork();
+         ++i)
+    {
+        status = ast_exec(entry->script.asts[i]);
         if (status != 0)
         {
-            fprintf(stderr, "Error executing line: %s\n", line);
+            fprintf(stderr, "Error executing a command of %s\n", filename);
             break;
         }
     }
-
-    free(line);
-    fclose(file);
+    entry->running--;
 
     return status;
 }
 
+void ast_exec_destroy(void)
+{
+    while (dot_scripts != NULL)
+    {
+        struct dot_script *next = dot_scripts->next;
+        script_free(&dot_scripts->script);
+        free(dot_scripts);
+        dot_scripts = next;
+    }
+    arena_destroy(&scratch);
+    free(status_text);
+    status_text = NULL;
+    builtin_destroy();
+    path_cache_destroy();
+}
+
 void ast_exported_variables(void)
 {
     extern char **environ;
@@ -835,18 +1016,17 @@ void ast_exported_variables(void)
     }
 }
 
-static int ast_exec_export(struct ast *ast)
+static int ast_exec_export(int argc, char **argv)
 {
-    if (ast->nb_sons == 0)
+    if (argc == 1)
     {
         ast_exported_variables();
         return 0;
     }
 
-    for (size_t i = 0; i < ast->nb_sons; i++)
+    for (int i = 1; i < argc; i++)
     {
-        struct ast *var_ast = ast_get_son(ast, i);
-        char *assignment = strdup(var_ast->value);
+        char *assignment = strdup(argv[i]);
         if (!assignment)
         {
             perror("strdup");
@@ -880,6 +1060,8 @@ static int ast_exec_export(struct ast *ast)
                 }
             }
         }
+        if (strcmp(assignment, "PATH") == 0)
+            path_cache_clear();
         free(assignment);
     }
 
@@ -914,9 +1096,9 @@ static int change_directory(const char *new_dir)
     return 0;
 }
 
-int ast_exec_cd(struct ast *ast)
+int ast_exec_cd(int argc, char **argv)
 {
-    if (ast->nb_sons > 0 && strcmp(ast_get_son(ast, 0)->value, "-") == 0)
+    if (argc > 1 && strcmp(argv[1], "-") == 0)
     {
         char *oldpwd = getenv("OLDPWD");
         if (!oldpwd)
@@ -927,7 +1109,7 @@ int ast_exec_cd(struct ast *ast)
         return change_directory(oldpwd);
     }
 
-    if (ast->nb_sons == 0)
+    if (argc == 1)
     {
         const char *home_dir = getenv("HOME");
         if (!home_dir)
@@ -938,13 +1120,14 @@ int ast_exec_cd(struct ast *ast)
         return change_directory(home_dir);
     }
 
-    const char *new_dir = ast_get_son(ast, ast->nb_sons - 1)->value;
+    const char *new_dir = argv[argc - 1];
     return change_directory(new_dir);
 }
 
-static int ast_exec_redir_folder_rec(struct ast *ast, struct ast *redir)
+// Applies the redirections of the folder from index, then runs its command
+static int ast_exec_redir_folder_rec(struct ast *ast, size_t index)
 {
-    if (redir == NULL)
+    if (index >= ast->nb_sons)
     {
         fflush(NULL);
         int return_code = ast_exec(ast_get_son(ast, 0));
@@ -953,27 +1136,32 @@ static int ast_exec_redir_folder_rec(struct ast *ast, struct ast *redir)
     }
     else
     {
+        struct ast *redir = ast->sons[index];
         if (redir->type == AST_REDIR_IN)
-            return ast_exec_redir_in(ast, redir);
+            return ast_exec_redir_in(ast, index);
         else if (redir->type == AST_REDIR_OUT)
-            return ast_exec_redir_out(ast, redir);
+            return ast_exec_redir_out(ast, index);
         else if (redir->type == AST_REDIR_APP_OUT)
-            return ast_exec_redir_app_out(ast, redir);
+            return ast_exec_redir_app_out(ast, index);
         else if (redir->type == AST_REDIR_DUP_IN)
-            return ast_exec_redir_dup_in(ast, redir);
+            return ast_exec_redir_dup_in(ast, index);
         else if (redir->type == AST_REDIR_DUP_OUT)
-            return ast_exec_redir_dup_out(ast, redir);
+            return ast_exec_redir_dup_out(ast, index);
         else if (redir->type == AST_REDIR_RW)
-            return ast_exec_redir_rw(ast, redir);
+            return ast_exec_redir_rw(ast, index);
+        else if (redir->type == AST_REDIR_HEREDOC
+                 || redir->type == AST_REDIR_HEREDOC_QUOTED)
+            return ast_exec_redir_heredoc(ast, index);
     }
     return EC_UNKNOWN;
 }
 
-static int ast_exec_redir_in(struct ast *ast, struct ast *redir)
+static int ast_exec_redir_in(struct ast *ast, size_t index)
 {
+    struct ast *redir = ast->sons[index];
     fflush(NULL);
     char *filename = redir->value;
-    int redir_fd = redir->nb_sons;
+    int redir_fd = redir->ionumber;
 
     int fd_in = open(filename, O_RDONLY);
     if (fd_in == -1)
@@ -992,7 +1180,7 @@ static int ast_exec_redir_in(struct ast *ast, struct ast *redir)
     }
     fflush(NULL);
 
-    int return_code = ast_exec_redir_folder_rec(ast, redir->right_brother);
+    int return_code = ast_exec_redir_folder_rec(ast, index + 1);
     fflush(NULL);
 
     close(redirection);
@@ -1004,11 +1192,12 @@ static int ast_exec_redir_in(struct ast *ast, struct ast *redir)
     return return_code;
 }
 
-static int ast_exec_redir_out(struct ast *ast, struct ast *redir)
+static int ast_exec_redir_out(struct ast *ast, size_t index)
 {
+    struct ast *redir = ast->sons[index];
     fflush(NULL);
     char *filename = redir->value;
-    int redir_fd = redir->nb_sons;
+    int redir_fd = redir->ionumber;
 
     // 6 * 64 + 4 * 8 + 4 = 420
     int fd_out = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 420);
@@ -1028,7 +1217,7 @@ static int ast_exec_redir_out(struct ast *ast, struct ast *redir)
     }
     fflush(NULL);
 
-    int return_code = ast_exec_redir_folder_rec(ast, redir->right_brother);
+    int return_code = ast_exec_redir_folder_rec(ast, index + 1);
     fflush(NULL);
 
     close(redirection);
@@ -1040,11 +1229,12 @@ static int ast_exec_redir_out(struct ast *ast, struct ast *redir)
     return return_code;
 }
 
-static int ast_exec_redir_app_out(struct ast *ast, struct ast *redir)
+static int ast_exec_redir_app_out(struct ast *ast, size_t index)
 {
+    struct ast *redir = ast->sons[index];
     fflush(NULL);
     char *filename = redir->value;
-    int redir_fd = redir->nb_sons;
+    int redir_fd = redir->ionumber;
 
     // 6 * 64 + 4 * 8 + 4 = 420
     int fd_app_out = open(filename, O_WRONLY | O_CREAT | O_APPEND, 420);
@@ -1066,7 +1256,7 @@ static int ast_exec_redir_app_out(struct ast *ast, struct ast *redir)
     }
     fflush(NULL);
 
-    int return_code = ast_exec_redir_folder_rec(ast, redir->right_brother);
+    int return_code = ast_exec_redir_folder_rec(ast, index + 1);
     fflush(NULL);
 
     close(redirection);
@@ -1078,21 +1268,22 @@ static int ast_exec_redir_app_out(struct ast *ast, struct ast *redir)
     return return_code;
 }
 
-static int ast_exec_redir_dup_in(struct ast *ast, struct ast *redir)
+static int ast_exec_redir_dup_in(struct ast *ast, size_t index)
 {
-    return ast_exec_redir_in(ast, redir);
+    return ast_exec_redir_in(ast, index);
 }
 
-static int ast_exec_redir_dup_out(struct ast *ast, struct ast *redir)
+static int ast_exec_redir_dup_out(struct ast *ast, size_t index)
 {
-    return ast_exec_redir_out(ast, redir);
+    return ast_exec_redir_out(ast, index);
 }
 
-static int ast_exec_redir_rw(struct ast *ast, struct ast *redir)
+static int ast_exec_redir_rw(struct ast *ast, size_t index)
 {
+    struct ast *redir = ast->sons[index];
     fflush(NULL);
     char *filename = redir->value;
-    int redir_fd = redir->nb_sons;
+    int redir_fd = redir->ionumber;
 
     int fd_rw = open(filename, O_RDWR | O_CREAT, 420);
     if (fd_rw == -1)
@@ -1111,7 +1302,7 @@ static int ast_exec_redir_rw(struct ast *ast, struct ast *redir)
     }
     fflush(NULL);
 
-    int return_code = ast_exec_redir_folder_rec(ast, redir->right_brother);
+    int return_code = ast_exec_redir_folder_rec(ast, index + 1);
     fflush(NULL);
 
     close(redirection);
@@ -1123,18 +1314,191 @@ static int ast_exec_redir_rw(struct ast *ast, struct ast *redir)
     return return_code;
 }
 
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t w = write(fd, buf, len);
+        if (w == -1)
+            return -1;
+        buf += w;
+        len -= w;
+    }
+    return 0;
+}
+
+// Returns a readable fd holding the here-document body, without touching the
+// disk. A body that fits in PIPE_BUF is written to a pipe right away, larger
+// ones go to an anonymous memory file. Without memfd, a forked writer feeds
+// the pipe, its pid is stored in *writer so it can be reaped.
+static int heredoc_fd(const char *body, pid_t *writer)
+{
+    size_t len = strlen(body);
+    *writer = -1;
+#ifdef MFD_CLOEXEC
+    if (len > PIPE_BUF)
+    {
+        int mem_fd = memfd_create("heredoc", MFD_CLOEXEC);
+        if (mem_fd != -1)
+        {
+            if (write_all(mem_fd, body, len) == 0
+                && lseek(mem_fd, 0, SEEK_SET) == 0)
+                return mem_fd;
+            close(mem_fd);
+        }
+    }
+#endif /* MFD_CLOEXEC */
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) == -1)
+        return -1;
+    if (len <= PIPE_BUF)
+    {
+        write_all(pipe_fds[1], body, len);
+        close(pipe_fds[1]);
+        return pipe_fds[0];
+    }
+
+    fflush(NULL);
+    *writer = fork();
+    if (*writer == 0)
+    {
+        close(pipe_fds[0]);
+        write_all(pipe_fds[1], body, len);
+        _exit(0);
+    }
+    close(pipe_fds[1]);
+    if (*writer == -1)
+    {
+        close(pipe_fds[0]);
+        return -1;
+    }
+    return pipe_fds[0];
+}
+
+static int ast_exec_redir_heredoc(struct ast *ast, size_t index)
+{
+    struct ast *redir = ast->sons[index];
+    fflush(NULL);
+    int redir_fd = redir->ionumber;
+
+    // Parameters are expanded in the body unless the delimiter was quoted
+    char *body = redir->value;
+    if (redir->type == AST_REDIR_HEREDOC)
+    {
+        body = handle_expension(redir->value);
+        if (body == NULL)
+            return EC_UNKNOWN;
+    }
+
+    pid_t writer;
+    int fd_heredoc = heredoc_fd(body, &writer);
+    if (body != redir->value)
+        free(body);
+    if (fd_heredoc == -1)
+    {
+        fprintf(stderr, "ast_exec_redir_heredoc: Could not create body.\n");
+        return EC_UNKNOWN;
+    }
+
+    int stdin_dup = dup(redir_fd);
+
+    int redirection = dup2(fd_heredoc, redir_fd);
+    if (redirection == -1)
+    {
+        fprintf(stderr,
+                "ast_exec_redir_heredoc: Could not create redirection.\n");
+        close(fd_heredoc);
+        return EC_UNKNOWN;
+    }
+    fflush(NULL);
+
+    int return_code = ast_exec_redir_folder_rec(ast, index + 1);
+    fflush(NULL);
+
+    close(redirection);
+    close(fd_heredoc);
+    dup2(stdin_dup, redir_fd);
+    close(stdin_dup);
+    fflush(NULL);
+
+    // Once the read end is closed, a writer that was not drained gets EPIPE
+    if (writer > 0)
+        waitpid(writer, NULL, 0);
+
+    return return_code;
+}
+
 static int ast_exec_redir_folder(struct ast *ast)
 {
     if (ast->nb_sons < 2)
         return ast_exec(ast_get_son(ast, 0));
     else
-        return ast_exec_redir_folder_rec(ast, ast_get_son(ast, 1));
+        return ast_exec_redir_folder_rec(ast, 1);
+}
+
+/*
+** The builtins of the shell, registered by ast_exec_init. A new builtin is a
+** new entry. POSIX special builtins are found before functions.
+*/
+static const struct
+{
+    const char *name;
+    int (*run)(int argc, char **argv);
+    int flags;
+} shell_builtins[] = {
+    { ":", ast_exec_true, BUILTIN_SPECIAL },
+    { ".", ast_exec_dot, BUILTIN_SPECIAL },
+    { "break", ast_exec_break, BUILTIN_SPECIAL },
+    { "continue", ast_exec_continue, BUILTIN_SPECIAL },
+    { "exit", ast_exec_exit, BUILTIN_SPECIAL },
+    { "export", ast_exec_export, BUILTIN_SPECIAL },
+    { "unset", ast_exec_unset, BUILTIN_SPECIAL },
+    { "true", ast_exec_true, 0 },
+    { "false", ast_exec_false, 0 },
+    { "cd", ast_exec_cd, 0 },
+    { "echo", ast_exec_echo, 0 },
+    { "hash", ast_exec_hash, 0 },
+    { "command", ast_exec_command_builtin, 0 },
+};
+
+int ast_exec_init(void)
+{
+    for (size_t i = 0; i < sizeof(shell_builtins) / sizeof(*shell_builtins);
+         ++i)
+        if (!builtin_register(shell_builtins[i].name, shell_builtins[i].run,
+                              shell_builtins[i].flags))
+            return 0;
+    return 1;
 }
 
 #if 0
 static int ast_exec_(struct ast *ast)
 #endif /* 0 */
 
+void ast_exec_set_status(int code)
+{
+    struct variable *status = hash_variable_get("?");
+    if (status_text != NULL && code == status_code && status != NULL
+        && strcmp(status->value, status_text) == 0)
+        return;
+
+    //? $? holds what itoa prints, even for 0 and negative codes
+    char *text = itoa(code);
+    char *name = strdup("?");
+    char *value = text == NULL ? NULL : strdup(text);
+    if (name == NULL || value == NULL || !hash_variable_set(name, value))
+    {
+        free(text);
+        free(name);
+        free(value);
+        return;
+    }
+    free(status_text);
+    status_text = text;
+    status_code = code;
+}
+
 static int (*array_ast_exec[])(struct ast *ast) = {
     [AST_COMMAND] = ast_exec_command,
     [AST_COMMAND_LIST] = ast_exec_command_list,
@@ -1160,10 +1524,6 @@ int ast_exec(struct ast *ast)
     if (ast == NULL)
         return 0;
     int return_code = array_ast_exec[ast->type](ast);
-    char *var_name = malloc(sizeof(char) * 2);
-    var_name[0] = '?';
-    var_name[1] = '\0';
-    char *var_value = itoa(return_code);
-    hash_variable_set(var_name, var_value);
+    ast_exec_set_status(return_code);
     return return_code;
 }
@@ -16,9 +16,47 @@
 // This will help ensure forked processes don't interact with the main process.
 int current_42sh_is_a_fork(void);
 
+/**
+ ** \brief Registers the builtins of the shell, which must be done before
+ ** anything is parsed: commands are resolved to them once parsed. Returns 0
+ ** on error.
+ */
+int ast_exec_init(void);
+
 /**
  ** \brief Execute ast recursively, return value is bash return code
  */
 int ast_exec(struct ast *ast);
 
+/**
+ ** \brief Sets $? to a return code, as done once any node has run
+ */
+void ast_exec_set_status(int code);
+
+/**
+ ** \brief Keeps count of the loops running, for break and continue. A loop
+ ** calls ast_exec_loop_enter first and ast_exec_loop_leave once done.
+ */
+void ast_exec_loop_enter(void);
+void ast_exec_loop_leave(void);
+
+/**
+ ** \brief Handles the code returned by the body of a loop: a break or a
+ ** continue aimed at this loop is consumed and *code reset to 0. Returns 0
+ ** if the loop must stop, with *code its return code.
+ */
+int ast_exec_loop_body(int *code);
+
+/**
+ ** \brief Sets the variable of a for loop to a word of its list, expanded
+ ** first. Returns 0 on error.
+ */
+int ast_exec_for_bind(const char *name, const struct ast *word);
+
+/**
+ ** \brief Frees what the executor keeps between commands: the scripts the
+ ** dot builtin parsed, the scratch area of expansions and the builtins.
+ */
+void ast_exec_destroy(void);
+
 #endif /* ! AST_EXEC_H */
@@ -0,0 +1,56 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+
+#include "ast.h"
+#include "builtins/builtins.h"
+
+// Whether a part of an expansion is copied as is when it is expanded
+static int part_is_literal(const struct ast *part)
+{
+    //? handle_expension only acts on '$' and on the '\' escaping it
+    return part->type == AST_EXPARG_NORM
+        || strpbrk(part->value, "$\\") == NULL;
+}
+
+// Folds an expansion without anything to expand into its word
+static void resolve_expansion(struct ast *ast)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < ast->nb_sons; ++i)
+    {
+        if (!part_is_literal(ast->sons[i]))
+            return;
+        len += strlen(ast->sons[i]->value);
+    }
+
+    char *word = ast_new_value(ast, len);
+    if (word == NULL)
+        return; // It is expanded when it runs instead
+    len = 0;
+    for (size_t i = 0; i < ast->nb_sons; ++i)
+    {
+        size_t n = strlen(ast->sons[i]->value);
+        memcpy(word + len, ast->sons[i]->value, n);
+        len += n;
+    }
+    ast->flags |= AST_LITERAL;
+}
+
+void ast_resolve(struct ast *ast)
+{
+    if (ast == NULL)
+        return;
+
+    if (ast->type == AST_ARGUMENT)
+        ast->flags |= AST_LITERAL;
+    else if (ast->type == AST_EXPANSION)
+        resolve_expansion(ast);
+    else if (ast->type == AST_COMMAND)
+        ast->builtin = builtin_get(ast->value);
+
+    // The parts of an expansion are read by ast_expand, not resolved
+    if (ast->type != AST_EXPANSION)
+        for (size_t i = 0; i < ast->nb_sons; ++i)
+            ast_resolve(ast->sons[i]);
+}
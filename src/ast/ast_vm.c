@@ -0,0 +1,190 @@
+#define _POSIX_C_SOURCE 200809L // unsetenv
+
+#include "ast_vm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../exit_codes.h"
+#include "ast_exec.h"
+
+/*
+** Instructions are dispatched by jumping from one to the next through a
+** table of labels where the compiler supports it (GCC and clang, outside of
+** strict ISO C), and by a switch otherwise.
+*/
+#if defined(__GNUC__) && !defined(__STRICT_ANSI__)
+#define VM_COMPUTED_GOTO
+#endif
+
+// What a running loop keeps
+struct loop_slot
+{
+    int code; // Return code of its last body, 0 before the first one
+    size_t index; // Next word of a for
+    int bound; // Whether the variable of a for was set by the loop
+};
+
+int bytecode_run(const struct bytecode *bc)
+{
+    const int *code = bc->code;
+    struct loop_slot *slots = NULL;
+    if (bc->nb_slots > 0
+        && (slots = calloc(bc->nb_slots, sizeof(struct loop_slot))) == NULL)
+    {
+        fprintf(stderr, "bytecode_run: Memory error.\n");
+        return EC_MEMORY;
+    }
+
+    size_t ip = 0;
+    int status = 0;
+
+#ifdef VM_COMPUTED_GOTO
+    static void *const targets[] = {
+        [OP_EXEC] = &&op_exec,
+        [OP_LOAD] = &&op_load,
+        [OP_STATUS] = &&op_status,
+        [OP_JUMP] = &&op_jump,
+        [OP_JUMP_ZERO] = &&op_jump_zero,
+        [OP_JUMP_NONZERO] = &&op_jump_nonzero,
+        [OP_NOT] = &&op_not,
+        [OP_LOOP_ENTER] = &&op_loop_enter,
+        [OP_FOR_NEXT] = &&op_for_next,
+        [OP_LOOP_BODY] = &&op_loop_body,
+        [OP_LOOP_LEAVE] = &&op_loop_leave,
+        [OP_RETURN] = &&op_return,
+    };
+#define DISPATCH() goto *targets[code[ip]]
+#else
+#define DISPATCH() goto dispatch
+#endif /* VM_COMPUTED_GOTO */
+
+    DISPATCH();
+
+#ifndef VM_COMPUTED_GOTO
+dispatch:
+    switch (code[ip])
+    {
+    case OP_EXEC:
+        goto op_exec;
+    case OP_LOAD:
+        goto op_load;
+    case OP_STATUS:
+        goto op_status;
+    case OP_JUMP:
+        goto op_jump;
+    case OP_JUMP_ZERO:
+        goto op_jump_zero;
+    case OP_JUMP_NONZERO:
+        goto op_jump_nonzero;
+    case OP_NOT:
+        goto op_not;
+    case OP_LOOP_ENTER:
+        goto op_loop_enter;
+    case OP_FOR_NEXT:
+        goto op_for_next;
+    case OP_LOOP_BODY:
+        goto op_loop_body;
+    case OP_LOOP_LEAVE:
+        goto op_loop_leave;
+    default:
+        goto op_return;
+    }
+#endif /* ! VM_COMPUTED_GOTO */
+
+op_exec:
+    status = ast_exec(bc->nodes[code[ip + 1]]);
+    ip = status < 0 ? (size_t)code[ip + 2] : ip + 3;
+    DISPATCH();
+
+op_load:
+    status = code[ip + 1];
+    ip += 2;
+    DISPATCH();
+
+op_status:
+    ast_exec_set_status(status);
+    ip += 1;
+    DISPATCH();
+
+op_jump:
+    ip = code[ip + 1];
+    DISPATCH();
+
+op_jump_zero:
+    ip = status == 0 ? (size_t)code[ip + 1] : ip + 2;
+    DISPATCH();
+
+op_jump_nonzero:
+    ip = status != 0 ? (size_t)code[ip + 1] : ip + 2;
+    DISPATCH();
+
+op_not:
+    //? A command not found stays one, errors were unwound
+    if (status != -EC_COMMAND_NOT_FOUND)
+        status = status == 0;
+    ip += 1;
+    DISPATCH();
+
+op_loop_enter:
+    ast_exec_loop_enter();
+    slots[code[ip + 1]].code = 0;
+    slots[code[ip + 1]].index = 0;
+    slots[code[ip + 1]].bound = 0;
+    ip += 2;
+    DISPATCH();
+
+    // The variable is overwritten by each word, and unset once the loop ends
+op_for_next: {
+    struct loop_slot *slot = &slots[code[ip + 1]];
+    struct ast *ast = bc->nodes[code[ip + 2]];
+    struct ast *list = ast_get_son(ast, 0);
+    if (slot->index < list->nb_sons)
+    {
+        if (ast_exec_for_bind(ast->value, ast_get_son(list, slot->index++)))
+        {
+            slot->bound = 1;
+            ip += 4;
+            DISPATCH();
+        }
+        //? The loop returns the error, as if its body had
+        slot->code = EC_MEMORY;
+    }
+    if (slot->bound)
+        unsetenv(ast->value);
+    ip = code[ip + 3];
+    DISPATCH();
+}
+
+op_loop_body: {
+    struct loop_slot *slot = &slots[code[ip + 1]];
+    slot->code = status;
+    int next = ast_exec_loop_body(&slot->code);
+    if (!next && code[ip + 2] != -1)
+        unsetenv(bc->nodes[code[ip + 2]]->value);
+    ip = next ? ip + 4 : (size_t)code[ip + 3];
+    DISPATCH();
+}
+
+op_loop_leave:
+    ast_exec_loop_leave();
+    status = slots[code[ip + 1]].code;
+    ast_exec_set_status(status);
+    ip = status < 0 ? (size_t)code[ip + 2] : ip + 3;
+    DISPATCH();
+
+op_return:
+    free(slots);
+    return status;
+}
+
+int ast_vm_exec(struct ast *ast)
+{
+    struct bytecode bc;
+    if (!ast_compile(&bc, ast))
+        return ast_exec(ast);
+
+    int status = bytecode_run(&bc);
+    bytecode_free(&bc);
+    return status;
+}
@@ -0,0 +1,67 @@
+#ifndef AST_VM_H
+#define AST_VM_H
+
+#include "ast.h"
+
+/*
+** The instructions of the bytecode, each followed by its operands. The VM
+** has a single register, the return code of what ran last, and a slot per
+** loop running. Instructions that run code jump to their unwind operand when
+** it returns an internal error (< 0), such as a break: to the end of the body
+** of the enclosing loop, or to the end of the program.
+*/
+enum opcode
+{
+    OP_EXEC, // node, unwind: runs a node with ast_exec
+    OP_LOAD, // value: sets the return code
+    OP_STATUS, // sets $? to the return code
+    OP_JUMP, // target
+    OP_JUMP_ZERO, // target: jumps if the return code is 0
+    OP_JUMP_NONZERO, // target: jumps if the return code is not 0
+    OP_NOT, // negates the return code, as '!' does
+    OP_LOOP_ENTER, // slot: starts a loop
+    OP_FOR_NEXT, // slot, node, exit: sets the variable of a for to its next
+                 // word, or unsets it and jumps to exit once all are done
+    OP_LOOP_BODY, // slot, node, exit: handles what the body returned, break
+                  // and continue, and jumps to exit if the loop must stop.
+                  // node is the for whose variable is then unset, or -1.
+    OP_LOOP_LEAVE, // slot, unwind: ends a loop, its return code is the one of
+                   // its last body
+    OP_RETURN, // ends the program
+};
+
+struct bytecode
+{
+    int *code; ///< Instructions, each an opcode and its operands
+    size_t size; ///< Words of code
+    size_t capacity;
+    struct ast **nodes; ///< The nodes instructions refer to, by index
+    size_t nb_nodes;
+    size_t nodes_capacity;
+    size_t nb_slots; ///< Loops nested at once
+};
+
+/*
+** \brief Compiles ast into bc. Only the control flow (lists, if, while,
+** until, for, !, && and ||) is compiled, other nodes are run by ast_exec
+** from a single instruction: bc refers to them and must not outlive ast.
+** Returns 0 on a memory error.
+*/
+int ast_compile(struct bytecode *bc, struct ast *ast);
+
+/*
+** \brief Runs compiled code, with the same effects and return code as
+** ast_exec on the tree it was compiled from.
+*/
+int bytecode_run(const struct bytecode *bc);
+
+void bytecode_free(struct bytecode *bc);
+
+/*
+** \brief Executes ast by compiling it first, or through ast_exec if it
+** cannot be compiled. The bodies of the functions it calls are not compiled:
+** calls are single instructions, whose bodies ast_exec walks as trees.
+*/
+int ast_vm_exec(struct ast *ast);
+
+#endif /* ! AST_VM_H */
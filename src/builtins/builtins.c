@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 200809L // strdup
+
+#include "builtins.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../fnv.h"
+
+/*
+** The builtins, by open addressing: a name is in the first free slot from
+** its hash on. The table is at most half full and never has a hole, as
+** builtins are not removed.
+*/
+static struct builtin **slots = NULL;
+static size_t capacity = 0;
+static size_t nb_builtins = 0;
+
+// The slot of name in table, or the free slot it would take
+static struct builtin **find_slot(struct builtin **table, size_t size,
+                                  const char *name)
+{
+    size_t i = fnv_hash_string(name) & (size - 1);
+    while (table[i] != NULL && strcmp(table[i]->name, name) != 0)
+        i = (i + 1) & (size - 1);
+    return &table[i];
+}
+
+static int grow(void)
+{
+    size_t new_capacity = capacity ? 2 * capacity : BUILTINS_MIN_CAPACITY;
+    struct builtin **table = calloc(new_capacity, sizeof(struct builtin *));
+    if (table == NULL)
+        return 0;
+
+    for (size_t i = 0; i < capacity; ++i)
+        if (slots[i] != NULL)
+            *find_slot(table, new_capacity, slots[i]->name) = slots[i];
+
+    free(slots);
+    slots = table;
+    capacity = new_capacity;
+    return 1;
+}
+
+int builtin_register(const char *name, int (*run)(int argc, char **argv),
+                     int flags)
+{
+    if (2 * (nb_builtins + 1) > capacity && !grow())
+        return 0;
+
+    struct builtin **slot = find_slot(slots, capacity, name);
+    if (*slot == NULL)
+    {
+        struct builtin *builtin = malloc(sizeof(struct builtin));
+        char *copy = strdup(name);
+        if (builtin == NULL || copy == NULL)
+        {
+            free(builtin);
+            free(copy);
+            return 0;
+        }
+        builtin->name = copy;
+        *slot = builtin;
+        ++nb_builtins;
+    }
+
+    (*slot)->run = run;
+    (*slot)->flags = flags;
+    return 1;
+}
+
+const struct builtin *builtin_get(const char *name)
+{
+    if (nb_builtins == 0)
+        return NULL;
+    return *find_slot(slots, capacity, name);
+}
+
+void builtin_destroy(void)
+{
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        if (slots[i] != NULL)
+        {
+            free(slots[i]->name);
+            free(slots[i]);
+        }
+    }
+
+    free(slots);
+    slots = NULL;
+    capacity = 0;
+    nb_builtins = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <stddef.h>
+
+#define BUILTINS_MIN_CAPACITY 32 // First number of slots, a power of two
+#define BUILTIN_SPECIAL 0x1 // A POSIX special builtin, found before functions
+
+/*
+** A command run by the shell itself. It is given the words of the command
+** like a program, argv[0] being its name and argv NULL-terminated.
+*/
+struct builtin
+{
+    char *name;
+    int (*run)(int argc, char **argv);
+    int flags; ///< BUILTIN_SPECIAL
+};
+
+/*
+** \brief Registers a builtin under name, or replaces the one registered
+** under it: what found the previous one then finds this one. Returns 0 on
+** error.
+*/
+int builtin_register(const char *name, int (*run)(int argc, char **argv),
+                     int flags);
+
+/*
+** \brief Returns the builtin registered under name, NULL if none. It stays
+** valid until builtin_destroy.
+*/
+const struct builtin *builtin_get(const char *name);
+
+/*
+** \brief Frees every builtin registered.
+*/
+void builtin_destroy(void);
+
+#endif /* ! BUILTINS_H */
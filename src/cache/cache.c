@@ -0,0 +1,409 @@
+#define _DEFAULT_SOURCE // realpath, st_mtim
+
+#include "cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../fnv.h"
+
+#define CACHE_MAGIC "42shAST" // 8 bytes with its terminator
+
+// What follows a serialized node
+#define NODE_VALUE 0x1 // its value
+// Bytes of a node without value: type, flags, number of sons and fd
+#define NODE_MIN_SIZE (2 + sizeof(uint64_t) + sizeof(int32_t))
+
+/*
+** The start of an entry, followed by the path of the script and the
+** serialized commands. Entries are only read on the machine that wrote them.
+*/
+struct cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t path_length;
+    uint64_t device;
+    uint64_t inode;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t size;
+    uint64_t content_hash;
+    uint64_t nb_asts;
+    uint64_t payload_size;
+    uint64_t payload_hash;
+};
+
+struct buffer
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+struct reader
+{
+    const char *data;
+    size_t size;
+    size_t pos;
+};
+
+int cache_supports(struct IO *input)
+{
+    return input->type == IO_FILE && input->mapped && input->discarded == 0
+        && input->capacity <= CACHE_MAX_SIZE && IO_load(input);
+}
+
+// Returns the path of the cache directory, creating it if needed
+static char *cache_dir(void)
+{
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *suffix = "/42sh";
+    if (base == NULL || *base == '\0')
+    {
+        base = getenv("HOME");
+        suffix = "/.cache/42sh";
+    }
+    if (base == NULL || *base == '\0')
+        return NULL;
+
+    size_t len = strlen(base) + strlen(suffix) + 1;
+    char *dir = malloc(len);
+    if (dir == NULL)
+        return NULL;
+    snprintf(dir, len, "%s%s", base, suffix);
+
+    //? mkdir -p, only the last two levels may be missing
+    char *slash = strrchr(dir, '/');
+    *slash = '\0';
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+    {
+        free(dir);
+        return NULL;
+    }
+    *slash = '/';
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+    {
+        free(dir);
+        return NULL;
+    }
+
+    return dir;
+}
+
+// Entries are named after a hash of the absolute path of the script
+static char *entry_path(const char *real_path)
+{
+    char *dir = cache_dir();
+    if (dir == NULL)
+        return NULL;
+
+    size_t len = strlen(dir) + 1 + 16 + 1;
+    char *entry = malloc(len);
+    if (entry != NULL)
+        snprintf(entry, len, "%s/%016llx", dir,
+                 (unsigned long long)fnv_hash(real_path, strlen(real_path)));
+
+    free(dir);
+    return entry;
+}
+
+static int header_init(struct cache_header *header, const char *real_path,
+                       struct IO *input)
+{
+    struct stat st;
+    if (fstat(input->fd, &st) == -1)
+        return 0;
+
+    memset(header, 0, sizeof(struct cache_header));
+    memcpy(header->magic, CACHE_MAGIC, sizeof(header->magic));
+    header->version = CACHE_VERSION;
+    header->path_length = strlen(real_path);
+    header->device = st.st_dev;
+    header->inode = st.st_ino;
+    header->mtime_sec = st.st_mtim.tv_sec;
+    header->mtime_nsec = st.st_mtim.tv_nsec;
+    header->size = input->size;
+    header->content_hash = fnv_hash(input->buffer, input->size);
+    return 1;
+}
+
+// Whether the entry was built from this version of the script
+static int header_matches(const struct cache_header *entry,
+                          const struct cache_header *script)
+{
+    return memcmp(entry->magic, script->magic, sizeof(entry->magic)) == 0
+        && entry->version == script->version
+        && entry->path_length == script->path_length
+        && entry->device == script->device && entry->inode == script->inode
+        && entry->mtime_sec == script->mtime_sec
+        && entry->mtime_nsec == script->mtime_nsec
+        && entry->size == script->size
+        && entry->content_hash == script->content_hash;
+}
+
+static int buffer_write(struct buffer *buffer, const void *data, size_t len)
+{
+    if (buffer->size + len > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (buffer->size + len > capacity)
+            capacity *= 2;
+
+        char *new_data = realloc(buffer->data, capacity);
+        if (new_data == NULL)
+            return 0;
+        buffer->data = new_data;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, len);
+    buffer->size += len;
+    return 1;
+}
+
+/*
+** Serializes a node and then its sons. Each node is its type, what follows
+** it, its number of sons, its fd if it is a redirection and its value if any.
+*/
+static int write_node(struct buffer *buffer, const struct ast *ast)
+{
+    unsigned char node[2] = { ast->type, 0 };
+    if (ast->value != NULL)
+        node[1] |= NODE_VALUE;
+
+    uint64_t nb_sons = ast->nb_sons;
+    int32_t ionumber = ast->ionumber;
+    if (!buffer_write(buffer, node, sizeof(node))
+        || !buffer_write(buffer, &nb_sons, sizeof(nb_sons))
+        || !buffer_write(buffer, &ionumber, sizeof(ionumber)))
+        return 0;
+
+    if (ast->value != NULL)
+    {
+        uint32_t len = strlen(ast->value);
+        if (!buffer_write(buffer, &len, sizeof(len))
+            || !buffer_write(buffer, ast->value, len))
+            return 0;
+    }
+
+    for (size_t i = 0; i < ast->nb_sons; ++i)
+        if (!write_node(buffer, ast->sons[i]))
+            return 0;
+
+    return 1;
+}
+
+static int read_bytes(struct reader *reader, void *data, size_t len)
+{
+    if (len > reader->size - reader->pos)
+        return 0;
+
+    memcpy(data, reader->data + reader->pos, len);
+    reader->pos += len;
+    return 1;
+}
+
+// The reverse of write_node, NULL if the data is truncated or invalid
+static struct ast *read_node(struct reader *reader)
+{
+    unsigned char node[2];
+    uint64_t nb_sons;
+    int32_t ionumber;
+    if (!read_bytes(reader, node, sizeof(node))
+        || !read_bytes(reader, &nb_sons, sizeof(nb_sons))
+        || !read_bytes(reader, &ionumber, sizeof(ionumber))
+        || node[0] > AST_FUNCDEC
+        || nb_sons > (reader->size - reader->pos) / NODE_MIN_SIZE)
+        return NULL;
+
+    char *value = NULL;
+    if (node[1] & NODE_VALUE)
+    {
+        uint32_t len;
+        if (!read_bytes(reader, &len, sizeof(len))
+            || len > reader->size - reader->pos)
+            return NULL;
+        if ((value = ast_strndup(reader->data + reader->pos, len)) == NULL)
+            return NULL;
+        reader->pos += len;
+    }
+
+    struct ast *ast = ast_new(node[0], value);
+    if (ast == NULL)
+    {
+        ast_free_value(value);
+        return NULL;
+    }
+    ast->ionumber = ionumber;
+
+    for (uint64_t i = 0; i < nb_sons; ++i)
+    {
+        struct ast *son = read_node(reader);
+        if (son == NULL || !ast_append_son(ast, son))
+        {
+            ast_free(son);
+            ast_free(ast);
+            return NULL;
+        }
+    }
+
+    return ast;
+}
+
+// Reads a whole entry, which is at most a few times bigger than its script
+static char *read_entry(const char *entry, size_t *size)
+{
+    int fd = open(entry, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && (size_t)st.st_size >= sizeof(struct cache_header)
+        && (size_t)st.st_size <= 64 * (size_t)CACHE_MAX_SIZE)
+        data = malloc(st.st_size);
+
+    size_t done = 0;
+    while (data != NULL && done < (size_t)st.st_size)
+    {
+        ssize_t r = read(fd, data + done, st.st_size - done);
+        if (r <= 0)
+        {
+            free(data);
+            data = NULL;
+        }
+        else
+            done += r;
+    }
+
+    close(fd);
+    *size = done;
+    return data;
+}
+
+static int load_entry(struct script *script, const char *data, size_t size,
+                      const struct cache_header *expected,
+                      const char *real_path)
+{
+    struct cache_header header;
+    memcpy(&header, data, sizeof(header));
+    size_t offset = sizeof(header) + header.path_length;
+    if (!header_matches(&header, expected) || offset > size
+        || memcmp(data + sizeof(header), real_path, header.path_length) != 0
+        || header.payload_size != size - offset
+        || header.payload_hash != fnv_hash(data + offset, size - offset))
+        return 0;
+
+    struct reader reader = { .data = data + offset, .size = size - offset };
+    for (uint64_t i = 0; i < header.nb_asts; ++i)
+    {
+        struct ast *ast = read_node(&reader);
+        if (ast == NULL || !script_append(script, ast))
+        {
+            ast_free(ast);
+            script_free(script);
+            return 0;
+        }
+    }
+
+    return reader.pos == reader.size;
+}
+
+int cache_load(struct script *script, const char *path, struct IO *input)
+{
+    char *real_path = realpath(path, NULL);
+    char *entry = real_path == NULL ? NULL : entry_path(real_path);
+
+    int hit = 0;
+    struct cache_header expected;
+    size_t size;
+    char *data;
+    if (entry != NULL && header_init(&expected, real_path, input)
+        && (data = read_entry(entry, &size)) != NULL)
+    {
+        struct arena *previous = ast_set_arena(&script->arena);
+        hit = load_entry(script, data, size, &expected, real_path);
+        //? What ast_resolve finds is not stored, it is found again
+        for (size_t i = 0; hit && i < script->nb_asts; ++i)
+            ast_resolve(script->asts[i]);
+        ast_set_arena(previous);
+        if (!hit)
+            script_free(script);
+        free(data);
+    }
+
+    free(entry);
+    free(real_path);
+    return hit;
+}
+
+static int write_all(int fd, const void *data, size_t len)
+{
+    const char *bytes = data;
+    while (len > 0)
+    {
+        ssize_t w = write(fd, bytes, len);
+        if (w == -1)
+            return 0;
+        bytes += w;
+        len -= w;
+    }
+
+    return 1;
+}
+
+// Writes the entry next to its final path, and renames it once complete
+static void write_entry(const char *entry, const struct cache_header *header,
+                        const char *real_path, const struct buffer *payload)
+{
+    size_t len = strlen(entry) + sizeof(".XXXXXX");
+    char *tmp = malloc(len);
+    if (tmp == NULL)
+        return;
+    snprintf(tmp, len, "%s.XXXXXX", entry);
+
+    int fd = mkstemp(tmp);
+    if (fd != -1)
+    {
+        int ok = write_all(fd, header, sizeof(struct cache_header))
+            && write_all(fd, real_path, header->path_length)
+            && write_all(fd, payload->data, payload->size);
+        if (close(fd) == -1 || !ok || rename(tmp, entry) == -1)
+            unlink(tmp);
+    }
+
+    free(tmp);
+}
+
+void cache_store(const struct script *script, const char *path,
+                 struct IO *input)
+{
+    char *real_path = realpath(path, NULL);
+    char *entry = real_path == NULL ? NULL : entry_path(real_path);
+
+    struct cache_header header;
+    struct buffer payload = { .data = NULL };
+    int ok = entry != NULL && header_init(&header, real_path, input);
+    for (size_t i = 0; ok && i < script->nb_asts; ++i)
+        ok = write_node(&payload, script->asts[i]);
+
+    if (ok)
+    {
+        header.nb_asts = script->nb_asts;
+        header.payload_size = payload.size;
+        header.payload_hash = fnv_hash(payload.data, payload.size);
+        write_entry(entry, &header, real_path, &payload);
+    }
+
+    free(payload.data);
+    free(entry);
+    free(real_path);
+}
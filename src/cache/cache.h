@@ -0,0 +1,37 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+#include "IO_Backend/io.h"
+#include "ast/ast.h"
+#include "parser/parser.h"
+
+#define CACHE_MAX_SIZE (1024 * 1024) // Bigger scripts are not cached
+#define CACHE_VERSION 3 // Changed with the format of the entries or the AST
+
+/*
+** \brief Returns whether the script read from input can be cached: it must
+** be a regular file that is not too big. It is then read fully in memory.
+*/
+int cache_supports(struct IO *input);
+
+/*
+** \brief Fills script with the commands cached for the script at path, read
+** from input. Returns 0 on a miss: no entry, or an entry for another version
+** of the file, or a corrupted one. It must then be rebuilt.
+**
+** Entries are stored in $XDG_CACHE_HOME/42sh (or $HOME/.cache/42sh), named
+** after the path of the script. They are checked against its inode, its
+** modification time and a hash of its content.
+*/
+int cache_load(struct script *script, const char *path, struct IO *input);
+
+/*
+** \brief Stores the commands of the script at path in the cache, replacing
+** its entry atomically. Failures are silent, the script is parsed next time.
+*/
+void cache_store(const struct script *script, const char *path,
+                 struct IO *input);
+
+#endif /* !CACHE_H */
@@ -0,0 +1,42 @@
+#ifndef FNV_H
+#define FNV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// FNV-1a, 64 bits
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/*
+** \brief Hashes len bytes of data. Quick and well spread for hash tables and
+** to tell contents apart, but not meant to resist collisions made on purpose.
+*/
+static inline uint64_t fnv_hash(const char *data, size_t len)
+{
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+** \brief Hashes a string as fnv_hash does its bytes, without its length.
+*/
+static inline uint64_t fnv_hash_string(const char *str)
+{
+    uint64_t hash = FNV_OFFSET;
+    for (; *str != '\0'; ++str)
+    {
+        hash ^= (unsigned char)*str;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+#endif /* ! FNV_H */
@@ -44,6 +44,10 @@ void hash_function_del(char *name)
 // the table shall not be used afterwards.
 void hash_function_destroy(void)
 {
+    // a body may define other functions: ast_free skips them as long as their
+    // entries, names and body pointers, are still there
+    for (size_t i = 0; i < HASH_TABLE_SIZE; ++i)
+        ll_function_free_values(&funcs.table[i]);
     for (size_t i = 0; i < HASH_TABLE_SIZE; ++i)
         ll_function_destroy(&funcs.table[i]);
 }
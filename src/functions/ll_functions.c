@@ -104,7 +104,17 @@ void ll_function_del(struct function **list, char *name)
     }
 }
 
-// frees all of the function list.
+// frees the bodies of all the functions of the list, but keeps their names.
+void ll_function_free_values(struct function **list)
+{
+    if (list == NULL)
+        return;
+
+    for (struct function *current = *list; current; current = current->next)
+        ast_free(current->value);
+}
+
+// frees all of the function list, once its bodies have been freed.
 // the list may be used afterwards.
 void ll_function_destroy(struct function **list)
 {
@@ -118,7 +128,6 @@ void ll_function_destroy(struct function **list)
     {
         struct function *next = current->next;
         free(current->name);
-        ast_free(current->value);
         free(current);
         current = next;
     }
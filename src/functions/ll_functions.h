@@ -29,7 +29,12 @@ struct function *ll_function_get(struct function **list, char *name);
 // the 'name' parameter will not be freed inside the function.
 void ll_function_del(struct function **list, char *name);
 
-// frees all of the function list.
+// frees the bodies of all the functions of the list, but keeps their names.
+// the functions still point to their freed bodies: the list shall only be
+// given to ll_function_destroy afterwards.
+void ll_function_free_values(struct function **list);
+
+// frees all of the function list, once its bodies have been freed.
 // the list may be used afterwards.
 void ll_function_destroy(struct function **list);
 
@@ -1,6 +1,7 @@
 #include "expansion.h"
 
 #include "../variables/shell_variables.h"
+#include "scan.h"
 #include "string.h"
 
 int is_special_char(char c)
@@ -26,6 +27,27 @@ char *add_char_bis(char *word, char c, int *index, unsigned *word_size)
     return word;
 }
 
+static char *add_run_bis(char *word, const char *run, size_t len, int *index,
+                         unsigned *word_size)
+{
+    if (*index + len > *word_size)
+    {
+        while (*index + len > *word_size)
+            *word_size *= 2;
+        word = realloc(word, *word_size);
+        if (word == NULL)
+        {
+            fprintf(stderr, "IO_read_word: realloc failed\n");
+            return NULL;
+        }
+    }
+
+    memcpy(word + *index, run, len);
+    *index += len;
+
+    return word;
+}
+
 char *handle_expension(char *word)
 {
     unsigned word_size = 1;
@@ -74,6 +96,7 @@ char *handle_expension(char *word)
             int var_name_index = 0;
             unsigned var_name_size = 1;
             while (word[i] && !is_special_char(word[i]) && word[i] != ' '
+                   && word[i] != '\t' && word[i] != '\n'
                    && word[i] != '}') //$ Variable name
             {
                 var_name = add_char_bis(var_name, word[i], &var_name_index,
@@ -162,8 +185,12 @@ char *handle_expension(char *word)
             free(var_name);
         }
 
-        else
-            new_word = add_char_bis(new_word, word[i], &index, &word_size);
+        else //$ Copy up to the next escape or expansion at once
+        {
+            size_t run = scan_until(word + i, word_len - i, "\\$", 2);
+            new_word = add_run_bis(new_word, word + i, run, &index, &word_size);
+            i += run - 1;
+        }
     }
 
     new_word = add_char_bis(new_word, '\0', &index, &word_size);
@@ -1,9 +1,28 @@
 #include "lexer.h"
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "IO_Backend/io.h"
+#include "arena/arena.h"
+#include "lexer_tables.h"
+#include "pretok.h"
+#include "scan.h"
+
+// What lex() does with the current character
+enum lex_action
+{
+    ACT_APPEND, // add it to the word
+    ACT_STOP, // end the token
+    ACT_OPERATOR, // read an operator token
+    ACT_DELIMIT, // end the word, the character starts the next token
+    ACT_QUOTE, // read a single quoted string
+    ACT_COMMENT, // skip until the end of the line
+    ACT_EXPAND, // read an expansion
+    ACT_ESCAPE // add the next character as is
+};
 
 struct arg_end_of_lex
 {
@@ -21,18 +40,29 @@ struct lexer *lexer_new(struct IO *input)
     }
 
     lexer->input = input;
-    lexer->current_tok.type = TOKEN_ERROR;
-    lexer->current_tok.value = NULL;
+    arena_init(&lexer->arena);
+    lexer->lookahead_start = 0;
+    lexer->lookahead_count = 0;
     lexer->state = LEXER_NORMAL;
     lexer->exp_state = EXP_NONE;
+    lexer->heredoc_end = 0;
+    lexer->pretok = NULL;
 
     return lexer;
 }
 
+void lexer_pretokenize(struct lexer *lexer)
+{
+    if (lexer->pretok == NULL)
+        lexer->pretok = pretok_new(lexer->input);
+}
+
 void lexer_free(struct lexer *lexer)
 {
     if (lexer)
     {
+        pretok_free(lexer->pretok);
+        arena_destroy(&lexer->arena);
         if (lexer->input)
             IO_free(lexer->input);
 
@@ -40,71 +70,17 @@ void lexer_free(struct lexer *lexer)
     }
 }
 
-static enum token_type get_char_type(char c)
-{
-    switch (c)
-    {
-    case ';':
-        return TOKEN_SEMI_COL;
-    case '\n':
-        return TOKEN_LF;
-    case '|':
-        return TOKEN_PIPE;
-    case '!':
-        return TOKEN_NOT;
-    case '$':
-        return TOKEN_EXPANDABLE;
-    case '"':
-        return TOKEN_EXPANDABLE;
-    case '(':
-        return TOKEN_LPAREN;
-    case ')':
-        return TOKEN_RPAREN;
-    case '{':
-        return TOKEN_LBRACKET;
-    case '}':
-        return TOKEN_RBRACKET;
-    default:
-        return TOKEN_ERROR;
-    }
-}
-
-static enum token_type check_for_reserved_word(char *word)
-{
-    if (strcmp(word, "if") == 0)
-        return TOKEN_IF;
-    else if (strcmp(word, "then") == 0)
-        return TOKEN_THEN;
-    else if (strcmp(word, "elif") == 0)
-        return TOKEN_ELIF;
-    else if (strcmp(word, "else") == 0)
-        return TOKEN_ELSE;
-    else if (strcmp(word, "fi") == 0)
-        return TOKEN_FI;
-    else if (strcmp(word, "for") == 0)
-        return TOKEN_FOR;
-    else if (strcmp(word, "in") == 0)
-        return TOKEN_IN;
-    else if (strcmp(word, "while") == 0)
-        return TOKEN_WHILE;
-    else if (strcmp(word, "until") == 0)
-        return TOKEN_UNTIL;
-    else if (strcmp(word, "do") == 0)
-        return TOKEN_DO;
-    else if (strcmp(word, "done") == 0)
-        return TOKEN_DONE;
-    else
-        return TOKEN_WORD;
-}
-
-static int is_number(char c)
-{
-    return c >= '0' && c <= '9';
-}
-
-static int is_letter(char c)
+// Quiet lexers only count their diagnostics, their input is lexed again
+static void lexer_error(struct lexer *lexer, const char *format, ...)
 {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    lexer->nb_errors++;
+    if (lexer->quiet)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
 }
 
 /*
@@ -113,17 +89,17 @@ static int is_letter(char c)
 ** variable name : [a-zA-Z_][a-zA-Z0-9_]*
 ** Example: var=value
 */
-int is_assignment_word_str(char *word)
+int is_assignment_word_str(const char *word, size_t len)
 {
-    int i = 0;
-    if (word[i] == '=' || !(is_letter(word[i]) || word[i] == '_'))
+    size_t i = 0;
+    if (len == 0 || !is_name_start(word[i]))
         return 0;
 
-    while (word[i] != '\0')
+    while (i < len)
     {
         if (word[i] == '=')
             return 1;
-        if (!(is_letter(word[i]) || is_number(word[i]) || word[i] == '_'))
+        if (!is_name(word[i]))
             return 0;
         ++i;
     }
@@ -131,29 +107,31 @@ int is_assignment_word_str(char *word)
     return 0;
 }
 
-int is_assignment_word(struct token tok)
+int is_assignment_word(struct lexer *lexer, struct token tok)
 {
     if (tok.type != TOKEN_EXPANDABLE)
-        return is_assignment_word_str(tok.value);
+    {
+        size_t len;
+        const char *text = lexer_token_text(lexer, tok, &len);
+        return is_assignment_word_str(text, len);
+    }
 
-    struct expansion *head = tok.first;
+    struct segment *head = &tok.segments[0];
     if (head->type != NORMAL)
         return 0;
 
-    return is_assignment_word_str(head->value);
+    return is_assignment_word_str(head->value, strlen(head->value));
 }
 
-char *add_char(char *word, char c, int *index, unsigned *word_size)
+static char *add_char(struct arena *arena, char *word, char c, int *index,
+                      unsigned *word_size)
 {
     if ((unsigned)*index >= *word_size)
     {
-        *word_size *= 2;
-        word = realloc(word, *word_size);
+        word = arena_grow(arena, word, *word_size, *word_size * 2);
         if (word == NULL)
-        {
-            fprintf(stderr, "IO_read_word: realloc failed\n");
             return NULL;
-        }
+        *word_size *= 2;
     }
 
     word[(*index)++] = c;
@@ -161,83 +139,163 @@ char *add_char(char *word, char c, int *index, unsigned *word_size)
     return word;
 }
 
-static void get_quoted_string(struct lexer *lexer, char **word, int *i,
-                              unsigned *word_size)
+static char *add_run(struct arena *arena, char *word, const char *run,
+                     size_t len, int *index, unsigned *word_size)
 {
-    char c = get_char(lexer->input);
-    while (c != '\'')
+    if (*index + len > *word_size)
     {
-        if (c == EOF)
-        {
-            fprintf(stderr, "IO_read_word: EOF reached before closing quote\n");
-            free(*word);
-            lexer->state = LEXER_ERROR;
-            return;
-        }
-
-        *word = add_char(*word, c, i, word_size);
-        c = get_char(lexer->input);
+        unsigned size = *word_size;
+        while (*index + len > size)
+            size *= 2;
+        word = arena_grow(arena, word, *word_size, size);
+        if (word == NULL)
+            return NULL;
+        *word_size = size;
     }
+
+    memcpy(word + *index, run, len);
+    *index += len;
+
+    return word;
 }
 
-static char check_for_fun(struct lexer *lexer, struct token *tok, int i,
-                          unsigned word_size)
+/*
+** Returns a copy of the first len bytes of value, with room for at least a
+** terminator, and stores its size in size.
+*/
+static char *copy_value(struct lexer *lexer, const char *value, int len,
+                        unsigned *size)
 {
-    fseek(lexer->input->input, -1, SEEK_CUR);
-    char c = get_char(lexer->input);
+    *size = BASE_VALUE_SIZE;
+    while ((unsigned)len >= *size)
+        *size *= 2;
+
+    char *copy = arena_alloc(&lexer->arena, *size);
+    if (copy != NULL)
+        memcpy(copy, value, len);
+    return copy;
+}
 
-    while (c == ' ' || c == '\t')
-        c = get_char(lexer->input);
+/*
+** Tokens are views of the input until a quote, an escape or an expansion
+** makes their value differ from it: the i bytes read so far are then copied.
+*/
+static void materialize(struct lexer *lexer, struct token *tok, int i,
+                        unsigned *word_size)
+{
+    if (tok->value != NULL)
+        return;
 
-    if (c == '(')
+    const char *text = IO_view(lexer->input, tok->offset);
+    tok->value = copy_value(lexer, text, i, word_size);
+}
+
+/*
+** Moves the input to the next of the given stop characters (or its end),
+** adding what was skipped to word unless it is NULL. Returns that character.
+*/
+static char read_run(struct lexer *lexer, char **word, int *i,
+                     unsigned *word_size, const char *stops, size_t nb_stops)
+{
+    size_t len;
+    const char *run = IO_run(lexer->input, &len);
+    while (len > 0)
     {
-        c = get_char(lexer->input);
+        size_t n = scan_until(run, len, stops, nb_stops);
+        if (word != NULL)
+            *word = add_run(&lexer->arena, *word, run, n, i, word_size);
+        IO_skip(lexer->input, n);
+        if (n < len)
+            break;
+        run = IO_run(lexer->input, &len);
+    }
 
-        while (c == ' ' || c == '\t')
-            c = get_char(lexer->input);
+    return get_char(lexer->input);
+}
 
-        if (c == ')')
-        {
-            tok->type = TOKEN_FUNCTION_WORD;
-            tok->value = add_char(tok->value, '\0', &i, &word_size);
-        }
+/*
+** Same as read_run with the word stops, only counting the bytes in i while
+** the word is a view. Most words are short, so their first bytes are checked
+** with the character class table before using the kernel.
+*/
+static char read_word_run(struct lexer *lexer, char **word, int *i,
+                          unsigned *word_size)
+{
+    size_t len;
+    const char *run = IO_run(lexer->input, &len);
+    while (len > 0)
+    {
+        size_t n = 0;
+        while (n < len && n < 16 && get_char_class(run[n]) == CC_WORD)
+            ++n;
+        if (n == 16)
+            n += scan_until(run + n, len - n, WORD_STOPS, NB_WORD_STOPS);
+
+        if (*word != NULL)
+            *word = add_run(&lexer->arena, *word, run, n, i, word_size);
         else
-            fseek(lexer->input->input, -1, SEEK_CUR);
+            *i += n;
+        IO_skip(lexer->input, n);
+        if (n < len)
+            break;
+        run = IO_run(lexer->input, &len);
     }
-    else
-        fseek(lexer->input->input, -1, SEEK_CUR);
 
-    return c;
+    return get_char(lexer->input);
 }
 
-static char is_io_number(struct lexer *lexer, struct token *tok, int *i,
-                         unsigned wordsize)
+/*
+** Appends a segment to the token. The array is allocated by powers of two from
+** BASE_SEGMENTS on, so that its capacity is known from its size.
+*/
+static struct segment *push_segment(struct lexer *lexer, struct token *tok,
+                                    enum expansion_type type, char *value)
 {
-    fseek(lexer->input->input, -1, SEEK_CUR);
-    char c = get_char(lexer->input);
-
-    while (c >= '0' && c <= '9')
+    size_t nb = tok->nb_segments;
+    size_t size = sizeof(struct segment);
+    if (nb == 0)
+        tok->segments = arena_alloc(&lexer->arena, BASE_SEGMENTS * size);
+    else if (nb >= BASE_SEGMENTS && (nb & (nb - 1)) == 0)
+        tok->segments =
+            arena_grow(&lexer->arena, tok->segments, nb * size, 2 * nb * size);
+    if (tok->segments == NULL)
     {
-        tok->value = add_char(tok->value, c, i, &wordsize);
-        c = get_char(lexer->input);
+        lexer_error(lexer, "push_segment: arena allocation failed\n");
+        tok->nb_segments = 0;
+        return NULL;
     }
 
-    if (c == '>' || c == '<')
+    struct segment *segment = &tok->segments[tok->nb_segments++];
+    segment->type = type;
+    segment->value = value;
+    return segment;
+}
+
+static struct segment *last_segment(struct token *tok)
+{
+    return &tok->segments[tok->nb_segments - 1];
+}
+
+static void get_quoted_string(struct lexer *lexer, char **word, int *i,
+                              unsigned *word_size)
+{
+    char c = read_run(lexer, word, i, word_size, "'\xff", 2);
+    if (c == EOF)
     {
-        tok->type = TOKEN_IONUMBER;
-        tok->value = add_char(tok->value, '\0', i, &wordsize);
+        lexer_error(lexer,
+                    "IO_read_word: EOF reached before closing quote\n");
+        *word = NULL;
+        lexer->state = LEXER_ERROR;
     }
-    else
-        tok->type = TOKEN_WORD;
-
-    return c;
 }
 
 static char handle_dq_var_utils(struct lexer *lexer, struct token *tok, int *j,
-                                unsigned exp_size)
+                                unsigned *exp_size)
 {
-    fseek(lexer->input->input, -1, SEEK_CUR);
+    unget_char(lexer->input);
     char c = get_char(lexer->input);
+    struct segment *segment = last_segment(tok);
+    struct arena *arena = &lexer->arena;
     if (lexer->state == LEXER_DQUOTE)
     {
         while (c != EOF && c != '\n' && c != '"')
@@ -247,21 +305,21 @@ static char handle_dq_var_utils(struct lexer *lexer, struct token *tok, int *j,
                 c = get_char(lexer->input);
                 if (c == '"' || c == '`' || c == '\\')
                 {
-                    tok->expansion->value =
-                        add_char(tok->expansion->value, c, j, &exp_size);
+                    segment->value =
+                        add_char(arena, segment->value, c, j, exp_size);
                 }
                 else
                 {
-                    tok->expansion->value =
-                        add_char(tok->expansion->value, '\\', j, &exp_size);
-                    tok->expansion->value =
-                        add_char(tok->expansion->value, c, j, &exp_size);
+                    segment->value =
+                        add_char(arena, segment->value, '\\', j, exp_size);
+                    segment->value =
+                        add_char(arena, segment->value, c, j, exp_size);
                 }
             }
             else
             {
-                tok->expansion->value =
-                    add_char(tok->expansion->value, c, j, &exp_size);
+                segment->value =
+                    add_char(arena, segment->value, c, j, exp_size);
             }
             c = get_char(lexer->input);
         }
@@ -271,8 +329,7 @@ static char handle_dq_var_utils(struct lexer *lexer, struct token *tok, int *j,
         while (c != EOF && c != '\n' && c != ' ' && c != ';' && c != '|'
                && c != '!' && c != '$' && c != '"')
         {
-            tok->expansion->value =
-                add_char(tok->expansion->value, c, j, &exp_size);
+            segment->value = add_char(arena, segment->value, c, j, exp_size);
             c = get_char(lexer->input);
         }
     }
@@ -283,15 +340,16 @@ static char handle_dq_var_utils(struct lexer *lexer, struct token *tok, int *j,
 static char handle_dq_variable(struct lexer *lexer, struct token *tok, int j,
                                unsigned exp_size)
 {
-    fseek(lexer->input->input, -1, SEEK_CUR);
+    unget_char(lexer->input);
     char c = get_char(lexer->input);
-    c = handle_dq_var_utils(lexer, tok, &j, exp_size);
+    c = handle_dq_var_utils(lexer, tok, &j, &exp_size);
 
     if (c == '"' && lexer->state == LEXER_DQUOTE)
         c = get_char(lexer->input);
 
-    tok->expansion->value =
-        add_char(tok->expansion->value, '\0', &j, &exp_size);
+    struct segment *segment = last_segment(tok);
+    segment->value =
+        add_char(&lexer->arena, segment->value, '\0', &j, &exp_size);
     j = 0;
 
     if (c == '$' || c == '"')
@@ -306,25 +364,22 @@ static char handle_dq_variable(struct lexer *lexer, struct token *tok, int j,
 
         unsigned exp_size = BASE_VALUE_SIZE;
 
-        struct expansion *next = calloc(1, sizeof(struct expansion));
-        next->value = calloc(BASE_VALUE_SIZE, sizeof(char));
-        next->type = DOUBLE_QUOTE;
-
+        enum expansion_type type = DOUBLE_QUOTE;
         if (lexer->state == LEXER_NORMAL && c != '$')
-            next->type = NORMAL;
+            type = NORMAL;
 
-        tok->expansion->next = next;
-        tok->expansion = next;
+        struct segment *next = push_segment(
+            lexer, tok, type, arena_alloc(&lexer->arena, BASE_VALUE_SIZE));
         int j = 0;
 
         if (c != '"')
-            tok->expansion->value =
-                add_char(tok->expansion->value, c, &j, &exp_size);
+            next->value =
+                add_char(&lexer->arena, next->value, c, &j, &exp_size);
 
         char b = get_char(lexer->input);
 
         if (c == '"' && b != '"' && b != '$')
-            tok->expansion->type = NORMAL;
+            next->type = NORMAL;
 
         c = b;
 
@@ -342,123 +397,13 @@ static char handle_dq_variable(struct lexer *lexer, struct token *tok, int j,
     return c;
 }
 
-static struct expansion *get_through_expansions(struct expansion *expansion)
-{
-    if (expansion == NULL)
-        return NULL;
-
-    struct expansion *current = expansion;
-
-    while (current->next != NULL)
-        current = current->next;
-
-    return current;
-}
-
-static char handle_redirection(struct lexer *lexer, struct token *tok, int *i,
-                               unsigned word_size)
-{
-    fseek(lexer->input->input, -1, SEEK_CUR);
-    char c = get_char(lexer->input);
-
-    char next_c = peek_char(lexer->input);
-    if (c == '>' && next_c == '>')
-    {
-        // Handle '>>' for append redirection
-        get_char(lexer->input); // Consume the second '>'
-        tok->type = TOKEN_REDIR_APP_OUT;
-        tok->value = add_char(tok->value, '>', i, &word_size);
-    }
-    else if (c == '>' && next_c == '|')
-    {
-        // Handle '>|' for redirection with |
-        get_char(lexer->input); // Consume the '|'
-        tok->type = TOKEN_REDIR_OUT;
-        tok->value = add_char(tok->value, '|', i, &word_size);
-    }
-    else if (c == '<' && next_c == '&')
-    {
-        // Handle '<&' for duplicating input file descriptor
-        get_char(lexer->input); // Consume the '&'
-        tok->type = TOKEN_REDIR_DUP_IN;
-        tok->value = add_char(tok->value, '&', i, &word_size);
-    }
-    else if (c == '>' && next_c == '&')
-    {
-        // Handle '>&' for duplicating output file descriptor
-        get_char(lexer->input); // Consume the '&'
-        tok->type = TOKEN_REDIR_DUP_OUT;
-        tok->value = add_char(tok->value, '&', i, &word_size);
-    }
-    else if (c == '<' && next_c == '>')
-    {
-        // Handle '<>' for read/write redirection
-        get_char(lexer->input); // Consume the '>'
-        tok->type = TOKEN_REDIR_RW;
-        tok->value = add_char(tok->value, '>', i, &word_size);
-    }
-    else
-    {
-        tok->type = (c == '>')
-            ? TOKEN_REDIR_OUT
-            : TOKEN_REDIR_IN; //$ Single character redirection
-    }
-
-    return c;
-}
-
-static char handle_stopping_char(struct lexer *lexer, struct token *tok, int *i,
-                                 unsigned *word_size)
-{
-    fseek(lexer->input->input, -1, SEEK_CUR);
-    char c = get_char(lexer->input);
-
-    if (*i == 0)
-    {
-        tok->value = add_char(tok->value, c, i, word_size);
-        //? Check for 'or'
-        if (c == '|' && peek_char(lexer->input) == '|')
-        {
-            get_char(lexer->input); // Consume the second '|'
-            tok->type = TOKEN_OR;
-            tok->value = add_char(tok->value, '|', i, word_size);
-        }
-        //? Check for 'and'
-        else if (c == '&' && peek_char(lexer->input) == '&')
-        {
-            get_char(lexer->input); // Consume the second '&'
-            tok->type = TOKEN_AND;
-            tok->value = add_char(tok->value, '&', i, word_size);
-        }
-        else
-            tok->type = get_char_type(c);
-    }
-    else //$ Stop reading word if you encounter a stoping character
-    {
-        if (c == '(') // Handle function word
-        {
-            tok->type = TOKEN_FUNCTION_WORD;
-            c = get_char(lexer->input);
-            while (c == ' ' || c == '\t')
-                c = get_char(lexer->input);
-
-            if (c != ')')
-                tok->type = TOKEN_ERROR;
-            return c;
-        }
-
-        fseek(lexer->input->input, -1, SEEK_CUR);
-    }
-
-    return c;
-}
-
 static char handle_simple_quote(struct lexer *lexer, struct token *tok, int *i,
                                 unsigned *word_size)
 {
-    fseek(lexer->input->input, -1, SEEK_CUR);
+    unget_char(lexer->input);
     char c = get_char(lexer->input);
 
+    materialize(lexer, tok, *i, word_size);
     get_quoted_string(lexer, &tok->value, i, word_size);
     if (lexer->state == LEXER_ERROR)
     {
@@ -476,31 +421,20 @@ static char handle_simple_quote(struct lexer *lexer, struct token *tok, int *i,
 static char handle_expandable_state(struct lexer *lexer, struct token *tok,
                                     int *i, unsigned *exp_size)
 {
-    fseek(lexer->input->input, -1, SEEK_CUR);
+    unget_char(lexer->input);
     char c = get_char(lexer->input);
 
-    struct expansion *next = calloc(1, sizeof(struct expansion));
-    next->value = calloc(BASE_VALUE_SIZE, sizeof(char));
-    next->type = NORMAL;
-
-    tok->expansion->next = next;
-    tok->expansion = get_through_expansions(tok->first);
-
-    strcpy(tok->expansion->value, tok->value);
+    struct segment *next = push_segment(
+        lexer, tok, NORMAL, copy_value(lexer, tok->value, *i, exp_size));
 
     // reset the tok value
-    free(tok->value);
-    tok->value = calloc(BASE_VALUE_SIZE, sizeof(char));
+    tok->value = arena_alloc(&lexer->arena, BASE_VALUE_SIZE);
 
-    tok->expansion->value = add_char(tok->expansion->value, '\0', i, exp_size);
+    next->value = add_char(&lexer->arena, next->value, '\0', i, exp_size);
     *i = 0;
 
-    struct expansion *after = calloc(1, sizeof(struct expansion));
-    after->value = calloc(*exp_size, sizeof(char));
-    after->type = DOUBLE_QUOTE;
-
-    tok->expansion->next = after;
-    tok->expansion = after;
+    push_segment(lexer, tok, DOUBLE_QUOTE,
+                 arena_alloc(&lexer->arena, *exp_size));
 
     if (c == '"')
         lexer->state = LEXER_DQUOTE;
@@ -508,11 +442,14 @@ static char handle_expandable_state(struct lexer *lexer, struct token *tok,
     return c;
 }
 
-static char handle_dq_var_lex(struct lexer *lexer, struct token *tok, int *i)
+static char handle_dq_var_lex(struct lexer *lexer, struct token *tok, int *i,
+                              unsigned *word_size)
 {
-    fseek(lexer->input->input, -1, SEEK_CUR);
+    unget_char(lexer->input);
     char c = get_char(lexer->input);
 
+    materialize(lexer, tok, *i, word_size);
+
     if (c == '"')
     {
         if (lexer->state != LEXER_DQUOTE)
@@ -525,35 +462,31 @@ static char handle_dq_var_lex(struct lexer *lexer, struct token *tok, int *i)
 
     if (lexer->exp_state != EXP_DQ_VAR)
     {
-        tok->expansion = calloc(1, sizeof(struct expansion));
-        tok->expansion->value = calloc(BASE_VALUE_SIZE, sizeof(char));
-
-        tok->expansion->type = DOUBLE_QUOTE;
-
+        enum expansion_type type = DOUBLE_QUOTE;
         if (lexer->state == LEXER_NORMAL && c != '$')
-            tok->expansion->type = NORMAL;
+            type = NORMAL;
 
-        tok->first = tok->expansion; //? Save the first expansion
+        //? The expansion starts the segments of the token over
+        tok->nb_segments = 0;
+        push_segment(lexer, tok, type,
+                     arena_alloc(&lexer->arena, BASE_VALUE_SIZE));
     }
 
     if (tok->type != TOKEN_EXPANDABLE && *i != 0)
     {
-        strcpy(tok->expansion->value, tok->value);
+        struct segment *segment = last_segment(tok);
+        segment->value = copy_value(lexer, tok->value, *i, &exp_size);
 
         // reset the tok value
-        free(tok->value);
-        tok->value = calloc(BASE_VALUE_SIZE, sizeof(char));
-
-        tok->expansion->type = NORMAL;
-        tok->expansion->value =
-            add_char(tok->expansion->value, '\0', i, &exp_size);
+        tok->value = arena_alloc(&lexer->arena, BASE_VALUE_SIZE);
 
-        struct expansion *next = calloc(1, sizeof(struct expansion));
-        next->value = calloc(BASE_VALUE_SIZE, sizeof(char));
-        next->type = DOUBLE_QUOTE;
+        segment->type = NORMAL;
+        segment->value =
+            add_char(&lexer->arena, segment->value, '\0', i, &exp_size);
 
-        tok->expansion->next = next;
-        tok->expansion = next;
+        push_segment(lexer, tok, DOUBLE_QUOTE,
+                     arena_alloc(&lexer->arena, BASE_VALUE_SIZE));
+        exp_size = BASE_VALUE_SIZE;
         *i = 0;
     }
     else if (lexer->exp_state == EXP_DQ_VAR)
@@ -564,8 +497,11 @@ static char handle_dq_var_lex(struct lexer *lexer, struct token *tok, int *i)
     int j = 0;
 
     if (c != '"')
-        tok->expansion->value =
-            add_char(tok->expansion->value, c, &j, &exp_size);
+    {
+        struct segment *segment = last_segment(tok);
+        segment->value =
+            add_char(&lexer->arena, segment->value, c, &j, &exp_size);
+    }
 
     c = get_char(lexer->input);
 
@@ -576,43 +512,41 @@ static char handle_dq_var_lex(struct lexer *lexer, struct token *tok, int *i)
 static char handle_end_of_lex(struct lexer *lexer, struct token *tok, int *i,
                               struct arg_end_of_lex aol)
 {
-    if (aol.c == EOF && strcmp(tok->value, "") == 0 && tok->first == NULL)
+    if (aol.c == EOF && *i == 0 && tok->nb_segments == 0)
     {
         if (lexer->exp_state == EXP_DQ_VAR)
             lexer->exp_state = EXP_NONE;
         tok->type = TOKEN_EOF;
     }
 
-    if ((aol.c == ' ' || aol.c == '\n') && strcmp(tok->value, "") == 0
+    if ((aol.c == ' ' || aol.c == '\n') && *i == 0
         && lexer->exp_state == EXP_DQ_VAR)
         lexer->exp_state = EXP_NONE;
 
-    if ((aol.c == ' ' || aol.c == '\t') && tok->type == TOKEN_WORD)
-        aol.c = check_for_fun(lexer, tok, *i, *(aol.word_size));
-
-    //? Add the null terminator
-    if (tok->type != TOKEN_FUNCTION_WORD)
-        tok->value = add_char(tok->value, '\0', i, aol.word_size);
+    //? Add the null terminator, views are not terminated
+    int len = *i;
+    if (tok->value != NULL)
+        tok->value =
+            add_char(&lexer->arena, tok->value, '\0', i, aol.word_size);
 
     //? Handle assignment word
-    if (is_assignment_word(*tok))
+    if (is_assignment_word(lexer, *tok))
         tok->type = TOKEN_ASSIGNMENT_WORD;
 
-    tok->expansion = get_through_expansions(tok->first);
-
     if (tok->type == TOKEN_WORD && lexer->state == LEXER_NORMAL)
-        tok->type = check_for_reserved_word(tok->value);
+    {
+        const char *text = tok->value;
+        if (text == NULL)
+            text = IO_view(lexer->input, tok->offset);
+        tok->type = lookup_reserved_word(text, len);
+    }
 
     if (tok->type == TOKEN_EXPANDABLE && lexer->exp_state == EXP_DQ_VAR)
     {
-        struct expansion *next = calloc(1, sizeof(struct expansion));
-        next->value = calloc(BASE_VALUE_SIZE, sizeof(char));
-        next->type = NORMAL;
-
-        tok->expansion->next = next;
-        tok->expansion = next;
-
-        strcpy(tok->expansion->value, tok->value);
+        unsigned exp_size;
+        char *value =
+            copy_value(lexer, tok->value, strlen(tok->value) + 1, &exp_size);
+        push_segment(lexer, tok, NORMAL, value);
         lexer->state = LEXER_NORMAL;
         lexer->exp_state = EXP_NONE;
     }
@@ -620,33 +554,25 @@ static char handle_end_of_lex(struct lexer *lexer, struct token *tok, int *i,
     return aol.c;
 }
 
-static int clang_dq_var(struct lexer *lexer, struct token *tok, int *i, char *c)
+static int clang_dq_var(struct lexer *lexer, struct token *tok, int *i, char *c,
+                        unsigned *word_size)
 {
-    *c = handle_dq_var_lex(lexer, tok, i);
+    *c = handle_dq_var_lex(lexer, tok, i, word_size);
 
     if (*c != ' ' && *c != EOF && *c != '\n' && *c != ';' && *c != '|'
         && *c != '!')
         lexer->exp_state = EXP_DQ_VAR;
     else
     {
-        // Feed the last char
-        if (*c != EOF)
-            fseek(lexer->input->input, -1, SEEK_CUR);
+        // Feed the last char, a blank is consumed like at the end of a word
+        if (*c != EOF && *c != ' ')
+            unget_char(lexer->input);
         return 1;
     }
 
     return 0;
 }
 
-static int check_for_stopping_char(char c)
-{
-    if (c == ';' || c == '\n' || c == '|' || c == '&' || c == '!' || c == '('
-        || c == ')' || c == '{' || c == '}')
-        return 1;
-
-    return 0;
-}
-
 static int clang_escaping(struct lexer *lexer, char *c)
 {
     *c = get_char(lexer->input);
@@ -664,94 +590,283 @@ static int clang_escaping(struct lexer *lexer, char *c)
 
 static void clang_while_handler(struct lexer *lexer, char *c)
 {
-    while (*c != EOF && *c != '\n')
-        *c = get_char(lexer->input);
+    if (*c != EOF && *c != '\n')
+        *c = read_run(lexer, NULL, NULL, NULL, "\n\xff", 2);
 
     return;
 }
 
+// Returns the position following the line at offset: after its newline, or
+// at the end of the input
+static size_t next_line(struct lexer *lexer, size_t offset)
+{
+    size_t len;
+    const char *run = IO_ahead(lexer->input, offset, &len);
+    while (len > 0)
+    {
+        const char *newline = memchr(run, '\n', len);
+        if (newline != NULL)
+            return offset + (newline - run) + 1;
+        offset += len;
+        run = IO_ahead(lexer->input, offset, &len);
+    }
+
+    return offset;
+}
+
+static int is_delimiter_line(struct lexer *lexer, struct heredoc *heredoc,
+                             size_t line, size_t end, const char *delimiter)
+{
+    const char *text = IO_view(lexer->input, line);
+    size_t len = end - line;
+    if (len > 0 && text[len - 1] == '\n')
+        --len;
+    if (heredoc->strip_tabs)
+        for (; len > 0 && *text == '\t'; --len)
+            ++text;
+
+    return len == strlen(delimiter) && memcmp(text, delimiter, len) == 0;
+}
+
+// Reads the delimiter of a here-document, and removes its quotes
+static char *read_delimiter(struct lexer *lexer, struct heredoc *heredoc)
+{
+    unsigned size = BASE_VALUE_SIZE;
+    int len = 0;
+    char *delimiter = arena_alloc(&lexer->arena, size);
+
+    char c = get_char(lexer->input);
+    while (c == ' ' || c == '\t')
+        c = get_char(lexer->input);
+
+    char quote = 0;
+    while (c != EOF
+           && (quote != 0
+               || (get_char_class(c) != CC_END
+                   && get_char_class(c) != CC_OPERATOR)))
+    {
+        if (c == '\'' || c == '"' || c == '\\')
+            heredoc->quoted = 1;
+
+        if (quote == 0 && (c == '\'' || c == '"'))
+            quote = c;
+        else if (quote != 0 && c == quote)
+            quote = 0;
+        else
+        {
+            if (quote != '\'' && c == '\\')
+                c = get_char(lexer->input);
+            if (c == EOF)
+                break;
+            delimiter = add_char(&lexer->arena, delimiter, c, &len, &size);
+        }
+        c = get_char(lexer->input);
+    }
+    if (c != EOF)
+        unget_char(lexer->input);
+
+    return add_char(&lexer->arena, delimiter, '\0', &len, &size);
+}
+
+/*
+** Reads the delimiter of a here-document and finds its body, which starts
+** after the line (or after the previous body of the line). The body stays in
+** the input, and is skipped once the newline is lexed.
+*/
+static void lex_heredoc(struct lexer *lexer, struct token *tok, int *i)
+{
+    struct heredoc *heredoc =
+        arena_alloc(&lexer->arena, sizeof(struct heredoc));
+    if (peek_char(lexer->input) == '-')
+    {
+        get_char(lexer->input);
+        heredoc->strip_tabs = 1;
+    }
+
+    char *delimiter = read_delimiter(lexer, heredoc);
+    *i = IO_tell(lexer->input) - tok->offset;
+    if (*delimiter == '\0')
+    {
+        lexer_error(lexer, "lex_heredoc: missing here-document delimiter\n");
+        tok->type = TOKEN_ERROR;
+        return;
+    }
+
+    size_t start = lexer->heredoc_end;
+    if (start == 0)
+        start = next_line(lexer, IO_tell(lexer->input));
+
+    size_t line = start;
+    size_t end = next_line(lexer, line);
+    while (end != line
+           && !is_delimiter_line(lexer, heredoc, line, end, delimiter))
+    {
+        line = end;
+        end = next_line(lexer, line);
+    }
+    if (end == line)
+        lexer_error(lexer,
+                    "lex_heredoc: here-document delimited by end-of-file "
+                    "(wanted '%s')\n",
+                    delimiter);
+
+    heredoc->offset = start;
+    heredoc->length = line - start;
+    lexer->heredoc_end = end;
+    tok->heredoc = heredoc;
+}
+
+// The bodies of the here-documents of a line follow its newline
+static void skip_heredocs(struct lexer *lexer)
+{
+    IO_skip(lexer->input, lexer->heredoc_end - IO_tell(lexer->input));
+    lexer->heredoc_end = 0;
+}
+
+/*
+** Operators are always views of the input. Only the ones that may have a
+** second character look at the next one: reading past a newline would wait
+** for the next line of a pipe before the command can run.
+*/
+static char lex_operator(struct lexer *lexer, struct token *tok, char c, int *i)
+{
+    ++*i;
+
+    if (!is_operator_prefix(c))
+    {
+        tok->type = lookup_operator(c, '\0');
+        return c;
+    }
+    char next = peek_char(lexer->input);
+    enum token_type type = lookup_operator(c, next);
+    if (next != EOF && next != '\0' && type != TOKEN_ERROR)
+    {
+        get_char(lexer->input); // Consume the second character
+        ++*i;
+        tok->type = type;
+        if (type == TOKEN_HEREDOC)
+            lex_heredoc(lexer, tok, i);
+    }
+    else
+        tok->type = lookup_operator(c, '\0');
+
+    return c;
+}
+
+// What lex() does with a character, given its class and whether a word has
+// been started (index 1) or not (index 0)
+static const enum lex_action lex_actions[2][NB_CHAR_CLASSES] = {
+    {
+        [CC_WORD] = ACT_APPEND,
+        [CC_END] = ACT_STOP,
+        [CC_OPERATOR] = ACT_OPERATOR,
+        [CC_SQUOTE] = ACT_QUOTE,
+        [CC_COMMENT] = ACT_COMMENT,
+        [CC_EXPAND] = ACT_EXPAND,
+        [CC_ESCAPE] = ACT_ESCAPE,
+    },
+    {
+        [CC_WORD] = ACT_APPEND,
+        [CC_END] = ACT_STOP,
+        [CC_OPERATOR] = ACT_DELIMIT,
+        [CC_SQUOTE] = ACT_QUOTE,
+        [CC_COMMENT] = ACT_APPEND,
+        [CC_EXPAND] = ACT_EXPAND,
+        [CC_ESCAPE] = ACT_ESCAPE,
+    },
+};
+
 struct token lex(struct lexer *lexer, char c, struct token tok,
                  unsigned word_size)
 {
     int i = 0;
+    int lexing = 1;
 
-    while (c != EOF && c != ' ')
+    while (lexing)
     {
-        if (c == '>' || c == '<')
+        switch (lex_actions[i != 0][get_char_class(c)])
         {
-            if (i == 0)
-            {
-                if (tok.type == TOKEN_IONUMBER)
-                    break;
-                tok.value = add_char(tok.value, c, &i, &word_size);
-                c = handle_redirection(lexer, &tok, &i, word_size);
-            }
-            else
-                fseek(lexer->input->input, -1, SEEK_CUR);
+        case ACT_STOP:
+            lexing = 0;
             break;
-        }
-        //? Check for stoping characters
-        if (check_for_stopping_char(c) == 1)
-        {
-            c = handle_stopping_char(lexer, &tok, &i, &word_size);
+        case ACT_OPERATOR:
+            c = lex_operator(lexer, &tok, c, &i);
+            lexing = 0;
             break;
-        }
-
-        if (c == '\'')
-        {
+        case ACT_DELIMIT: //$ The operator starts the next token
+            unget_char(lexer->input);
+            lexing = 0;
+            break;
+        case ACT_QUOTE:
             c = handle_simple_quote(lexer, &tok, &i, &word_size);
             if (tok.type == TOKEN_ERROR)
                 return tok;
-            continue;
-        }
-
-        //? Check for comment
-        if (c == '#' && i == 0)
-        {
+            break;
+        case ACT_COMMENT:
             clang_while_handler(lexer, &c);
 
+            // The token starts after the comment
+            tok.offset = IO_tell(lexer->input) - (c == EOF ? 0 : 1);
             if (c == EOF)
             {
                 tok.type = TOKEN_EOF;
+                lexing = 0;
                 break;
             }
-            fseek(lexer->input->input, -1, SEEK_CUR);
-            continue;
-        }
-
-        if (c == '$' || c == '"')
-        {
-            if (clang_dq_var(lexer, &tok, &i, &c) == 1)
+            unget_char(lexer->input);
+            c = get_char(lexer->input);
+            break;
+        case ACT_EXPAND:
+            if (clang_dq_var(lexer, &tok, &i, &c, &word_size) == 1)
+            {
+                lexing = 0;
                 break;
-        }
-
-        //? Escaping
-        if (c == '\\')
-        {
+            }
+            //? The character following the expansion is part of the word
+            if (c == '\\' && clang_escaping(lexer, &c) == 1)
+                break;
+            tok.value = add_char(&lexer->arena, tok.value, c, &i, &word_size);
+            c = get_char(lexer->input);
+            break;
+        case ACT_ESCAPE:
+            materialize(lexer, &tok, i, &word_size);
             if (clang_escaping(lexer, &c) == 1)
-                continue;
-        }
-
-        if (c >= '0' && c <= '9')
-            c = is_io_number(lexer, &tok, &i, word_size);
-        else
-        {
-            //? Add the character to the word
-            tok.value = add_char(tok.value, c, &i, &word_size);
+                break;
+            tok.value = add_char(&lexer->arena, tok.value, c, &i, &word_size);
             c = get_char(lexer->input);
+            break;
+        case ACT_APPEND: //$ Read the whole run of plain word characters
+            if (tok.value != NULL)
+                tok.value =
+                    add_char(&lexer->arena, tok.value, c, &i, &word_size);
+            else
+                ++i;
+            c = read_word_run(lexer, &tok.value, &i, &word_size);
+            break;
         }
     }
 
+    // Leave the blank ending the word in the input, so that the token ends
+    // exactly where its last character is
+    if (c == ' ')
+        unget_char(lexer->input);
+    tok.length = IO_tell(lexer->input) - tok.offset;
+    // A literal 0xFF byte ends a word like the end of the input, but is read
+    if (tok.value == NULL && tok.length != (size_t)i)
+        materialize(lexer, &tok, i, &word_size);
+    if (tok.type == TOKEN_LF && lexer->heredoc_end != 0)
+        skip_heredocs(lexer);
+
     struct arg_end_of_lex aol = { .word_size = &word_size, .c = c };
-    c = handle_end_of_lex(lexer, &tok, &i, aol);
+    handle_end_of_lex(lexer, &tok, &i, aol);
     return tok;
 }
 
-static struct token init_lex(struct lexer *lexer)
+struct token lexer_lex(struct lexer *lexer)
 {
+    // The token is a view of the input until it needs a value of its own
     struct token tok = { .type = TOKEN_WORD, .value = NULL };
     unsigned word_size = BASE_VALUE_SIZE;
-    tok.value = calloc(word_size, sizeof(char));
 
     //? Reset state
     lexer->state = LEXER_NORMAL;
@@ -759,60 +874,182 @@ static struct token init_lex(struct lexer *lexer)
     //? Read word
     char c = get_char(lexer->input);
 
-    //? Skip spaces
-    while (c == ' ')
+    //? Skip blanks
+    while (c == ' ' || c == '\t')
         c = get_char(lexer->input);
 
+    // get_char does not move past the end of the input
+    tok.offset = IO_tell(lexer->input) - (c == EOF ? 0 : 1);
     return lex(lexer, c, tok, word_size);
 }
 
-struct token lexer_peek(struct lexer *lexer)
+// Takes the next token from the pre-tokenizer, or lexes it here
+static struct token next_token(struct lexer *lexer)
 {
-    save(lexer->input);
-    struct token tok = init_lex(lexer);
-    restore(lexer->input);
+    if (lexer->pretok != NULL)
+    {
+        struct token tok;
+        if (pretok_next(lexer->pretok, &tok))
+            return tok;
 
-    return tok;
+        //? The rest of the input is lexed in order, from the cursor
+        pretok_free(lexer->pretok);
+        lexer->pretok = NULL;
+    }
+
+    return lexer_lex(lexer);
 }
-/*
- * TODO: rewrite with new lexer
+
+// Returns the n-th token of the lookahead, lexing the missing ones
+static struct token *lookahead_get(struct lexer *lexer, size_t n)
+{
+    while (lexer->lookahead_count < n)
+    {
+        size_t end =
+            (lexer->lookahead_start + lexer->lookahead_count) % LEXER_RING_SIZE;
+        lexer->lookahead[end] = next_token(lexer);
+        lexer->lookahead_count++;
+    }
+
+    return &lexer->lookahead[(lexer->lookahead_start + n - 1)
+                             % LEXER_RING_SIZE];
+}
+
+static int is_redirection_operator(enum token_type type)
+{
+    return type == TOKEN_REDIR_IN || type == TOKEN_REDIR_OUT
+        || type == TOKEN_REDIR_APP_OUT || type == TOKEN_REDIR_DUP_IN
+        || type == TOKEN_REDIR_DUP_OUT || type == TOKEN_REDIR_RW
+        || type == TOKEN_HEREDOC;
+}
+
+static int is_number_word(const char *word, size_t len)
+{
+    if (len == 0)
+        return 0;
+    for (size_t i = 0; i < len; ++i)
+        if (!is_digit(word[i]))
+            return 0;
+    return 1;
+}
+
+// An IO number is a word made of digits glued to a redirection operator, so
+// it is always a view of the input
+static void check_for_io_number(struct lexer *lexer, size_t n)
+{
+    struct token *tok = lookahead_get(lexer, n);
+    if (tok->type != TOKEN_WORD || tok->value != NULL
+        || !is_number_word(IO_view(lexer->input, tok->offset), tok->length))
+        return;
+
+    struct token *next = lookahead_get(lexer, n + 1);
+    if (is_redirection_operator(next->type)
+        && tok->offset + tok->length == next->offset)
+        tok->type = TOKEN_IONUMBER;
+}
+
+struct token lexer_peek(struct lexer *lexer)
+{
+    return lexer_peek_nth(lexer, 1);
+}
+
 struct token lexer_peek_nth(struct lexer *lexer, int n)
 {
-    if (n <= 0)
+    if (n <= 0 || n > LEXER_LOOKAHEAD)
     {
-        fprintf(stderr, "lexer_peek_nth: n must be > 0\n");
+        fprintf(stderr, "lexer_peek_nth: n must be in [1, %d]\n",
+                LEXER_LOOKAHEAD);
         return (struct token){ .type = TOKEN_ERROR, .value = NULL };
     }
 
-    char *next_word = IO_peek_word(lexer->input, n);
-    struct token tok = parse_word_for_tok(next_word);
+    check_for_io_number(lexer, n);
+    return *lookahead_get(lexer, n);
+}
+
+int lexer_peek_array(struct lexer *lexer, struct token *tokens, int n)
+{
+    if (n <= 0 || n > LEXER_LOOKAHEAD)
+    {
+        fprintf(stderr, "lexer_peek_array: n must be in [1, %d]\n",
+                LEXER_LOOKAHEAD);
+        return -1;
+    }
+
+    for (int i = 1; i <= n; ++i)
+        tokens[i - 1] = lexer_peek_nth(lexer, i);
+
+    return n;
+}
 
+struct token lexer_pop(struct lexer *lexer)
+{
+    struct token tok = lexer_peek_nth(lexer, 1);
+
+    // the ownership of the token goes to the caller
+    lexer->lookahead_start = (lexer->lookahead_start + 1) % LEXER_RING_SIZE;
+    lexer->lookahead_count--;
     return tok;
 }
-struct token *lexer_peek_array(struct lexer *lexer, int n)
+
+void lexer_release(struct lexer *lexer)
 {
-    if (n <= 0)
+    if (lexer->lookahead_count == 0)
     {
-        fprintf(stderr, "lexer_peek_array: n must be > 0\n");
-        return NULL;
+        arena_reset(&lexer->arena);
+        if (lexer->pretok != NULL)
+            pretok_release(lexer->pretok);
+        IO_discard(lexer->input);
     }
+}
 
-    struct token *tokens = calloc(n, sizeof(struct token));
-    for (int i = 1; i <= n; ++i)
+const char *lexer_token_text(struct lexer *lexer, struct token tok,
+                             size_t *len)
+{
+    if (tok.value != NULL)
+    {
+        *len = strlen(tok.value);
+        return tok.value;
+    }
+    if (tok.type == TOKEN_ERROR)
     {
-        tokens[i-1] = lexer_peek_nth(lexer, i);
+        *len = 0;
+        return "";
     }
 
-    return tokens;
+    *len = tok.length;
+    return IO_view(lexer->input, tok.offset);
 }
-*/
 
-struct token lexer_pop(struct lexer *lexer)
+char *lexer_heredoc_dup(struct lexer *lexer, struct token tok)
 {
-    struct token tok = init_lex(lexer);
-    lexer->current_tok = tok;
+    struct heredoc *heredoc = tok.heredoc;
+    const char *body = IO_view(lexer->input, heredoc->offset);
+    char *copy = malloc(heredoc->length + 1);
+    if (copy == NULL)
+    {
+        fprintf(stderr, "lexer_heredoc_dup: malloc failed\n");
+        return NULL;
+    }
 
-    return tok;
+    size_t len = 0;
+    int line_start = 1;
+    for (size_t i = 0; i < heredoc->length; ++i)
+    {
+        if (line_start && heredoc->strip_tabs && body[i] == '\t')
+            continue;
+        copy[len++] = body[i];
+        line_start = body[i] == '\n';
+    }
+    copy[len] = '\0';
+
+    return copy;
+}
+
+char *lexer_token_dup(struct lexer *lexer, struct token tok)
+{
+    size_t len;
+    const char *text = lexer_token_text(lexer, tok, &len);
+    return strndup(text, len);
 }
 
 struct lexer *lexer_new_from_string(const char *inputString)
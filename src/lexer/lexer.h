@@ -2,9 +2,16 @@
 #define LEXER_H
 
 #include "IO_Backend/io.h"
+#include "arena/arena.h"
 #include "token.h"
 
 #define BASE_VALUE_SIZE 16 // The base size of the buffer
+#define BASE_SEGMENTS 4 // The base capacity of a segment array
+#define LEXER_LOOKAHEAD 4 // How many tokens the parser can peek at once
+// One more token is lexed to tell whether the last one is an IO number
+#define LEXER_RING_SIZE (LEXER_LOOKAHEAD + 1)
+
+struct pretok;
 
 enum lexer_state
 {
@@ -25,9 +32,18 @@ enum lexer_exp_state
 struct lexer
 {
     struct IO *input; // The input data
-    struct token current_tok; // The next token, if processed
+    struct arena arena; // Where the tokens and their expansions are stored
+    struct token lookahead[LEXER_RING_SIZE]; // Tokens lexed ahead, as a ring
+    size_t lookahead_start; // Index of the next token in lookahead
+    size_t lookahead_count; // Number of tokens lexed ahead
     enum lexer_state state; // The current state of the lexer
     enum lexer_exp_state exp_state;
+    // End of the here-document bodies following the current line, 0 if the
+    // line has none
+    size_t heredoc_end;
+    struct pretok *pretok; // Tokens lexed ahead by other threads, or NULL
+    int quiet; // Errors are counted but not printed
+    size_t nb_errors;
 };
 
 /**
@@ -35,6 +51,14 @@ struct lexer
  */
 struct lexer *lexer_new(struct IO *input);
 
+/**
+ * \brief Lexes the rest of the input ahead on other threads when it is big
+ * enough and can be read in memory at once. The tokens and the errors stay
+ * the same.
+ * The shell only does it with --pretokenize.
+ */
+void lexer_pretokenize(struct lexer *lexer);
+
 /**
  ** \brief Free the given lexer, but not its input.
  */
@@ -48,55 +72,90 @@ void lexer_free(struct lexer *lexer);
  */
 struct token parse_word_for_tok(char *word);
 
+/**
+ * \brief Lexes the next token of the input, without the lookahead and the IO
+ * number detection.
+ */
+struct token lexer_lex(struct lexer *lexer);
+
 /**
  * \brief Returns the next token, but doesn't move forward: calling lexer_peek
  * multiple times in a row always returns the same result. This functions is
  * meant to help the parser check if the next token matches some rule.
  *
- * !IMPORTANT: This function allocates memory for the token value and DOES NOT
- * store it, !so you must free it after use.
+ * !IMPORTANT: The token is only lexed once and stays owned by the lexer: it
+ * is borrowed, !so you must NOT free it. It is valid until it is popped.
  */
 struct token lexer_peek(struct lexer *lexer);
 
 /**
  * \brief Returns the n-th next token, but doesn't move forward: calling
- * lexer_peek multiple times in a row always returns the same result. This
- * functions is meant to help the parser check if the next token matches some
- * rule.
+ * lexer_peek_nth multiple times in a row always returns the same result. This
+ * functions is meant to help the parser check if the next tokens match some
+ * rule. lexer_peek_nth(lexer, 1) is lexer_peek(lexer).
  *
- * !IMPORTANT: This function allocates memory for the token value and DOES NOT
- * store it, !so you must free it after use.
+ * !IMPORTANT: Like lexer_peek, the token is borrowed, !so you must NOT free it.
+ * It is valid until it is popped.
  *
  * \param lexer The lexer struct to read from.
  * \param n The index of the token to peek starting from current position.
- * n = 0 return a TOKEN_ERROR.
+ * n must be in [1, LEXER_LOOKAHEAD], otherwise TOKEN_ERROR is returned.
  */
-// struct token lexer_peek_nth(struct lexer *lexer, int n);
+struct token lexer_peek_nth(struct lexer *lexer, int n);
 
 /**
- * \brief Returns an array of n tokens, but doesn't move forward: calling
- * lexer_peek multiple times in a row always returns the same result. This
- * functions is meant to help the parser check if the next token matches some
- * rule.
+ * \brief Fills tokens with the n next tokens, but doesn't move forward.
  *
- * !IMPORTANT: This function allocates memory for the token value and DOES NOT
- * store it, !so you must free it after use.
+ * !IMPORTANT: The tokens are borrowed, !so you must NOT free them.
  *
  * \param lexer The lexer struct to read from.
- * \param n The number of tokens to peek starting from current position.
- * n = 0 return NULL.
+ * \param tokens An array of at least n tokens.
+ * \param n The number of tokens to peek, in [1, LEXER_LOOKAHEAD].
+ * \return n, or -1 if n is out of range.
  */
-// struct token *lexer_peek_array(struct lexer *lexer, int n);
+int lexer_peek_array(struct lexer *lexer, struct token *tokens, int n);
 
 /**
  * \brief Returns the next token, and removes it from the stream:
  *   calling lexer_pop in a loop will iterate over all tokens until EOF.
+ *
+ * !IMPORTANT: The token lives in the lexer's arena and input until
+ * lexer_release: copy what must outlive the command with lexer_token_dup.
+ * If it was peeked before, this is the very same token.
  */
 struct token lexer_pop(struct lexer *lexer);
 
-int is_assignment_word_str(char *word);
+/**
+ * \brief Releases the memory of every token popped so far at once, and the
+ * input they were read from. Does nothing while tokens are peeked, as they
+ * live in the same memory.
+ */
+void lexer_release(struct lexer *lexer);
+
+/**
+ * \brief Returns the text of the token and stores its length in len.
+ *
+ * !IMPORTANT: Most tokens are views of the input, whose text is NOT
+ * NUL-terminated. It is only valid until the lexer reads again.
+ */
+const char *lexer_token_text(struct lexer *lexer, struct token tok,
+                             size_t *len);
+
+/**
+ * \brief Returns a NUL-terminated heap copy of the text of the token, for
+ * what must outlive the command (the AST).
+ */
+char *lexer_token_dup(struct lexer *lexer, struct token tok);
+
+/**
+ * \brief Returns a NUL-terminated heap copy of the body of a TOKEN_HEREDOC,
+ * without the leading tabs of its lines for '<<-'.
+ */
+char *lexer_heredoc_dup(struct lexer *lexer, struct token tok);
+
+int is_assignment_word_str(const char *word, size_t len);
 
-int is_assignment_word(struct token tok);
+int is_assignment_word(struct lexer *lexer, struct token tok);
 
 struct lexer *lexer_new_from_string(const char *inputString);
 
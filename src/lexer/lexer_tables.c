@@ -0,0 +1,107 @@
+#include "lexer_tables.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LETTER (CC_WORD | CC_NAME_START | CC_NAME)
+#define DIGIT (CC_WORD | CC_NAME | CC_DIGIT)
+#define PREFIX (CC_OPERATOR | CC_OPERATOR_PREFIX)
+
+const unsigned char char_class[256] = {
+    [' '] = CC_END, [(unsigned char)EOF] = CC_END,
+
+    [';'] = CC_OPERATOR, ['\n'] = CC_OPERATOR, ['|'] = PREFIX,
+    ['&'] = PREFIX,      ['!'] = CC_OPERATOR,  ['('] = CC_OPERATOR,
+    [')'] = CC_OPERATOR, ['{'] = CC_OPERATOR,  ['}'] = CC_OPERATOR,
+    ['<'] = PREFIX,      ['>'] = PREFIX,
+
+    ['\''] = CC_SQUOTE, ['#'] = CC_COMMENT, ['$'] = CC_EXPAND,
+    ['"'] = CC_EXPAND, ['\\'] = CC_ESCAPE,
+
+    ['a'] = LETTER, ['b'] = LETTER, ['c'] = LETTER, ['d'] = LETTER,
+    ['e'] = LETTER, ['f'] = LETTER, ['g'] = LETTER, ['h'] = LETTER,
+    ['i'] = LETTER, ['j'] = LETTER, ['k'] = LETTER, ['l'] = LETTER,
+    ['m'] = LETTER, ['n'] = LETTER, ['o'] = LETTER, ['p'] = LETTER,
+    ['q'] = LETTER, ['r'] = LETTER, ['s'] = LETTER, ['t'] = LETTER,
+    ['u'] = LETTER, ['v'] = LETTER, ['w'] = LETTER, ['x'] = LETTER,
+    ['y'] = LETTER, ['z'] = LETTER,
+    ['A'] = LETTER, ['B'] = LETTER, ['C'] = LETTER, ['D'] = LETTER,
+    ['E'] = LETTER, ['F'] = LETTER, ['G'] = LETTER, ['H'] = LETTER,
+    ['I'] = LETTER, ['J'] = LETTER, ['K'] = LETTER, ['L'] = LETTER,
+    ['M'] = LETTER, ['N'] = LETTER, ['O'] = LETTER, ['P'] = LETTER,
+    ['Q'] = LETTER, ['R'] = LETTER, ['S'] = LETTER, ['T'] = LETTER,
+    ['U'] = LETTER, ['V'] = LETTER, ['W'] = LETTER, ['X'] = LETTER,
+    ['Y'] = LETTER, ['Z'] = LETTER,
+    ['_'] = LETTER,
+    ['0'] = DIGIT, ['1'] = DIGIT, ['2'] = DIGIT, ['3'] = DIGIT, ['4'] = DIGIT,
+    ['5'] = DIGIT, ['6'] = DIGIT, ['7'] = DIGIT, ['8'] = DIGIT, ['9'] = DIGIT,
+};
+
+struct keyword
+{
+    const char *name;
+    enum token_type type;
+};
+
+// The hash functions below have no collision on their keywords, so a lookup
+// is one hash and one comparison. Empty slots have no name.
+
+#define RESERVED_WORDS_SIZE 16
+
+static const struct keyword reserved_words[RESERVED_WORDS_SIZE] = {
+    [1] = { "until", TOKEN_UNTIL }, [2] = { "while", TOKEN_WHILE },
+    [3] = { "if", TOKEN_IF },       [5] = { "fi", TOKEN_FI },
+    [6] = { "then", TOKEN_THEN },   [7] = { "done", TOKEN_DONE },
+    [8] = { "else", TOKEN_ELSE },   [11] = { "in", TOKEN_IN },
+    [12] = { "for", TOKEN_FOR },    [13] = { "do", TOKEN_DO },
+    [15] = { "elif", TOKEN_ELIF },
+};
+
+static unsigned hash_reserved_word(const char *word, int len)
+{
+    unsigned first = (unsigned char)word[0];
+    unsigned last = (unsigned char)word[len - 1];
+    return (len * 8 + first + last * 7) % RESERVED_WORDS_SIZE;
+}
+
+enum token_type lookup_reserved_word(const char *word, int len)
+{
+    // reserved words are 2 to 5 characters long
+    if (len < 2 || len > 5)
+        return TOKEN_WORD;
+
+    const struct keyword *slot = &reserved_words[hash_reserved_word(word, len)];
+    if (slot->name != NULL && strncmp(slot->name, word, len) == 0
+        && slot->name[len] == '\0')
+        return slot->type;
+
+    return TOKEN_WORD;
+}
+
+#define OPERATORS_SIZE 37
+
+static const struct keyword operators[OPERATORS_SIZE] = {
+    [3] = { "(", TOKEN_LPAREN },          [4] = { ")", TOKEN_RPAREN },
+    [6] = { "<>", TOKEN_REDIR_RW },       [8] = { ">>", TOKEN_REDIR_APP_OUT },
+    [9] = { "<&", TOKEN_REDIR_DUP_IN },   [10] = { "\n", TOKEN_LF },
+    [11] = { ">&", TOKEN_REDIR_DUP_OUT }, [12] = { "{", TOKEN_LBRACKET },
+    [13] = { "|", TOKEN_PIPE },           [14] = { "}", TOKEN_RBRACKET },
+    [16] = { "||", TOKEN_OR },            [22] = { ";", TOKEN_SEMI_COL },
+    [23] = { "<", TOKEN_REDIR_IN },       [24] = { "&&", TOKEN_AND },
+    [25] = { ">", TOKEN_REDIR_OUT },      [28] = { ">|", TOKEN_REDIR_OUT },
+    [33] = { "!", TOKEN_NOT },            [34] = { "<<", TOKEN_HEREDOC },
+};
+
+static unsigned hash_operator(char c, char next)
+{
+    return ((unsigned char)c + (unsigned char)next * 23) % OPERATORS_SIZE;
+}
+
+enum token_type lookup_operator(char c, char next)
+{
+    const struct keyword *slot = &operators[hash_operator(c, next)];
+    if (slot->name != NULL && slot->name[0] == c && slot->name[1] == next)
+        return slot->type;
+
+    return TOKEN_ERROR;
+}
@@ -0,0 +1,262 @@
+#include "pretok.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "IO_Backend/io.h"
+#include "lexer.h"
+
+/*
+** Cuts the input from its cursor into chunks of about PRETOK_CHUNK_SIZE
+** bytes, each starting at the start of a line. Returns their number.
+*/
+static size_t pretok_split(struct pretok *pretok)
+{
+    struct IO *input = pretok->input;
+    size_t end = input->discarded + input->size;
+    size_t start = IO_tell(input);
+
+    size_t nb_chunks = 0;
+    pretok->chunks[nb_chunks++].start = start;
+    while (start + PRETOK_CHUNK_SIZE < end)
+    {
+        size_t from = start + PRETOK_CHUNK_SIZE;
+        const char *text = IO_view(input, from);
+        const char *newline = memchr(text, '\n', end - from);
+        if (newline == NULL || from + (newline - text) + 1 == end)
+            break;
+
+        start = from + (newline - text) + 1;
+        pretok->chunks[nb_chunks++].start = start;
+    }
+
+    return nb_chunks;
+}
+
+static int chunk_push(struct pretok_chunk *chunk, struct token tok)
+{
+    if (chunk->nb_tokens == chunk->capacity)
+    {
+        size_t capacity = chunk->capacity ? 2 * chunk->capacity : 256;
+        struct token *tokens =
+            realloc(chunk->tokens, capacity * sizeof(struct token));
+        if (tokens == NULL)
+            return 0;
+        chunk->tokens = tokens;
+        chunk->capacity = capacity;
+    }
+
+    chunk->tokens[chunk->nb_tokens++] = tok;
+    return 1;
+}
+
+/*
+** Lexes a chunk until a newline leaves the lexer at the start of a later chunk
+** in the state a new lexer would be in, or until the end of the input.
+*/
+static void chunk_lex(struct pretok *pretok, size_t k)
+{
+    struct pretok_chunk *chunk = &pretok->chunks[k];
+    chunk->next = pretok->nb_chunks;
+
+    struct IO *view = IO_create_view(pretok->input, chunk->start);
+    chunk->lexer = view == NULL ? NULL : lexer_new(view);
+    if (chunk->lexer == NULL)
+    {
+        IO_free(view);
+        chunk->failed = 1;
+        return;
+    }
+    struct lexer *lexer = chunk->lexer;
+    lexer->quiet = 1; // The chunk may start in the middle of a quote
+
+    size_t next = k + 1;
+    while (1)
+    {
+        struct token tok = lexer_lex(lexer);
+        if (!chunk_push(chunk, tok) || tok.type == TOKEN_ERROR
+            || lexer->nb_errors > 0)
+        {
+            chunk->failed = 1;
+            return;
+        }
+        if (tok.type == TOKEN_EOF)
+            return;
+        if (tok.type != TOKEN_LF || lexer->exp_state != EXP_NONE)
+            continue;
+
+        size_t pos = IO_tell(lexer->input);
+        while (next < pretok->nb_chunks && pretok->chunks[next].start < pos)
+            ++next;
+        if (next < pretok->nb_chunks && pretok->chunks[next].start == pos)
+        {
+            chunk->next = next;
+            return;
+        }
+    }
+}
+
+static void chunk_free(struct pretok_chunk *chunk)
+{
+    lexer_free(chunk->lexer);
+    chunk->lexer = NULL;
+    free(chunk->tokens);
+    chunk->tokens = NULL;
+}
+
+static void *pretok_worker(void *arg)
+{
+    struct pretok *pretok = arg;
+
+    pthread_mutex_lock(&pretok->lock);
+    while (!pretok->stop && pretok->next_chunk < pretok->nb_chunks)
+    {
+        size_t k = pretok->next_chunk;
+        if (k >= pretok->current + PRETOK_WINDOW)
+        {
+            //? Do not get too far ahead of the parser
+            pthread_cond_wait(&pretok->cond, &pretok->lock);
+            continue;
+        }
+        pretok->next_chunk++;
+
+        // The chunks the parser went past are not needed anymore
+        if (k >= pretok->current)
+        {
+            pthread_mutex_unlock(&pretok->lock);
+            chunk_lex(pretok, k);
+            pthread_mutex_lock(&pretok->lock);
+        }
+        pretok->chunks[k].done = 1;
+        pthread_cond_broadcast(&pretok->cond);
+    }
+    pthread_mutex_unlock(&pretok->lock);
+
+    return NULL;
+}
+
+struct pretok *pretok_new(struct IO *input)
+{
+    long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nb_cpus < 2 || !IO_load(input)
+        || input->size - input->pos < PRETOK_MIN_SIZE)
+        return NULL;
+
+    struct pretok *pretok = calloc(1, sizeof(struct pretok));
+    if (pretok == NULL)
+        return NULL;
+
+    pretok->input = input;
+    size_t max_chunks = (input->size - input->pos) / PRETOK_CHUNK_SIZE + 1;
+    pretok->chunks = calloc(max_chunks, sizeof(struct pretok_chunk));
+    if (pretok->chunks == NULL)
+    {
+        free(pretok);
+        return NULL;
+    }
+    pretok->nb_chunks = pretok_split(pretok);
+
+    pthread_mutex_init(&pretok->lock, NULL);
+    pthread_cond_init(&pretok->cond, NULL);
+    pretok->owner = getpid();
+
+    size_t nb_threads = PRETOK_MAX_THREADS;
+    if (nb_cpus < PRETOK_MAX_THREADS)
+        nb_threads = nb_cpus;
+    while (pretok->nb_threads < nb_threads
+           && pthread_create(&pretok->threads[pretok->nb_threads], NULL,
+                             pretok_worker, pretok)
+               == 0)
+        pretok->nb_threads++;
+
+    if (pretok->nb_threads == 0)
+    {
+        pretok_free(pretok);
+        return NULL;
+    }
+
+    return pretok;
+}
+
+// Waits for the thread lexing the current chunk
+static struct pretok_chunk *current_chunk(struct pretok *pretok)
+{
+    struct pretok_chunk *chunk = &pretok->chunks[pretok->current];
+
+    pthread_mutex_lock(&pretok->lock);
+    while (!chunk->done)
+        pthread_cond_wait(&pretok->cond, &pretok->lock);
+    pthread_mutex_unlock(&pretok->lock);
+
+    return chunk;
+}
+
+int pretok_next(struct pretok *pretok, struct token *tok)
+{
+    // Nothing would wake up a fork waiting for a chunk
+    if (pretok->owner != getpid())
+        return 0;
+
+    struct IO *input = pretok->input;
+    struct pretok_chunk *chunk = current_chunk(pretok);
+
+    while (!chunk->failed && pretok->index == chunk->nb_tokens)
+    {
+        pthread_mutex_lock(&pretok->lock);
+        pretok->current = chunk->next;
+        pretok->index = 0;
+        pthread_cond_broadcast(&pretok->cond);
+        pthread_mutex_unlock(&pretok->lock);
+
+        chunk = current_chunk(pretok);
+    }
+
+    if (chunk->failed)
+    {
+        //? Lexing the chunk again in order prints its errors in order
+        IO_skip(input, chunk->start - IO_tell(input));
+        return 0;
+    }
+
+    *tok = chunk->tokens[pretok->index];
+    if (tok->type != TOKEN_EOF)
+        pretok->index++;
+
+    size_t end = tok->offset + tok->length;
+    if (end > IO_tell(input))
+        IO_skip(input, end - IO_tell(input));
+    return 1;
+}
+
+void pretok_release(struct pretok *pretok)
+{
+    pthread_mutex_lock(&pretok->lock);
+    while (pretok->released < pretok->current
+           && pretok->chunks[pretok->released].done)
+        chunk_free(&pretok->chunks[pretok->released++]);
+    pthread_mutex_unlock(&pretok->lock);
+}
+
+void pretok_free(struct pretok *pretok)
+{
+    // A fork only has the thread that forked, the others may hold the lock
+    if (pretok == NULL || pretok->owner != getpid())
+        return;
+
+    pthread_mutex_lock(&pretok->lock);
+    pretok->stop = 1;
+    pthread_cond_broadcast(&pretok->cond);
+    pthread_mutex_unlock(&pretok->lock);
+
+    for (size_t i = 0; i < pretok->nb_threads; ++i)
+        pthread_join(pretok->threads[i], NULL);
+
+    for (size_t i = 0; i < pretok->nb_chunks; ++i)
+        chunk_free(&pretok->chunks[i]);
+    pthread_mutex_destroy(&pretok->lock);
+    pthread_cond_destroy(&pretok->cond);
+    free(pretok->chunks);
+    free(pretok);
+}
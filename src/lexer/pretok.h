@@ -0,0 +1,78 @@
+#ifndef PRETOK_H
+#define PRETOK_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "IO_Backend/io.h"
+#include "lexer.h"
+#include "token.h"
+
+#define PRETOK_MIN_SIZE (1024 * 1024) // Smaller inputs are lexed in order
+#define PRETOK_CHUNK_SIZE (256 * 1024) // Input given to a thread at once
+#define PRETOK_MAX_THREADS 4
+#define PRETOK_WINDOW (2 * PRETOK_MAX_THREADS) // Chunks lexed ahead at most
+
+/*
+** A part of the input lexed by a thread. Chunks start at the start of a line,
+** which may be inside a quote or a here-document: a chunk is only used once
+** the lexer of the previous one stopped right at its start, with nothing left
+** open. Otherwise that lexer goes on over it.
+*/
+struct pretok_chunk
+{
+    size_t start; // Position of the chunk in the input, a line start
+    struct lexer *lexer; // Lexes the input from start, owns the token values
+    struct token *tokens;
+    size_t nb_tokens;
+    size_t capacity;
+    size_t next; // Index of the chunk following the tokens
+    int done; // Set by the thread once the tokens are ready
+    int failed; // Lexing failed, the chunk is lexed again in order
+};
+
+struct pretok
+{
+    struct IO *input;
+    struct pretok_chunk *chunks;
+    size_t nb_chunks;
+
+    pthread_mutex_t lock; // Protects everything below
+    pthread_cond_t cond; // Signaled when a chunk is done or consumed
+    pthread_t threads[PRETOK_MAX_THREADS];
+    size_t nb_threads;
+    pid_t owner; // Forks do not have the threads
+    size_t next_chunk; // The next chunk to give to a thread
+    size_t current; // The chunk the tokens are taken from
+    size_t index; // The next token of the current chunk
+    size_t released; // Chunks before this one are freed, or being lexed
+    int stop;
+};
+
+/*
+** \brief Starts lexing the input from its cursor on other threads, once it is
+** read fully in memory. Returns NULL if the input is too small, cannot be read
+** at once (see IO_load) or if there is a single processor: it is better lexed
+** in order.
+*/
+struct pretok *pretok_new(struct IO *input);
+
+/*
+** \brief Stores the next token of the input in tok and moves the cursor of
+** the input after it, waiting for it to be lexed. Returns 0 if the rest of
+** the input must be lexed in order from its cursor instead, as in forks.
+*/
+int pretok_next(struct pretok *pretok, struct token *tok);
+
+/*
+** \brief Frees the tokens of the chunks that have been consumed. Their tokens
+** must not be used anymore.
+*/
+void pretok_release(struct pretok *pretok);
+
+/*
+** \brief Stops the threads and frees every token.
+*/
+void pretok_free(struct pretok *pretok);
+
+#endif /* !PRETOK_H */
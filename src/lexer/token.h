@@ -1,6 +1,8 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <stddef.h>
+
 enum token_type
 {
     //$ Reserved words
@@ -29,6 +31,7 @@ enum token_type
     TOKEN_REDIR_DUP_IN, // '<&'
     TOKEN_REDIR_DUP_OUT, // '>&'
     TOKEN_REDIR_RW, // '<>'
+    TOKEN_HEREDOC, // '<<' '<<-', with its delimiter and its body
     TOKEN_IONUMBER, // '[0-9]+'
 
     //$ Special characters
@@ -44,7 +47,6 @@ enum token_type
     TOKEN_WORD, // '[a-zA-Z0-9_]+'
     TOKEN_EXPANDABLE, // '$[a-zA-Z0-9_]+'
     TOKEN_ASSIGNMENT_WORD, // '[a-zA-Z0-9_]+='
-    TOKEN_FUNCTION_WORD, // '[a-zA-Z0-9_]+()'
     TOKEN_ERROR // it is not a real token, it is returned in case of invalid
                 // input
 };
@@ -55,21 +57,32 @@ enum expansion_type
     NORMAL,
 };
 
-struct expansion
+// The body of a here-document, a slice of the input
+struct heredoc
+{
+    size_t offset; // Position of the body in the input
+    size_t length;
+    int quoted; // The delimiter was quoted: the body is not expanded
+    int strip_tabs; // '<<-': leading tabs are removed from every line
+};
+
+// A part of an expandable token, quoted or not
+struct segment
 {
     enum expansion_type type; // The kind of expansion
     char *value;
-    struct expansion *next;
 };
 
 struct token
 {
     enum token_type type; // The kind of token
-    char *value; // The value of the token
-    struct expansion *expansion; // The expansion of the token
-    struct expansion *first; // The first expansion of the token
+    char *value; // The unescaped value, NULL if the token is a view
+                 // of the input (see lexer_token_text)
+    struct segment *segments; // The parts of an expandable token, in order
+    size_t nb_segments;
+    struct heredoc *heredoc; // The body of a TOKEN_HEREDOC
+    size_t offset; // Position of the token in the input
+    size_t length; // Number of input bytes the token spans
 };
 
-void token_free(struct token token);
-
 #endif /* !TOKEN_H */
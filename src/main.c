@@ -2,72 +2,183 @@
 
 #include "IO_Backend/io.h"
 #include "ast/ast_exec.h"
+#include "ast/ast_vm.h"
+#include "cache/cache.h"
 #include "exit_codes.h"
 #include "lexer/lexer.h"
+#include "parse_only.h"
 #include "parser/parser.h"
 #include "variables/shell_variables.h"
 
-#define SIZEOF_OPTIONS 1
+#define SIZEOF_OPTIONS 7
 
-struct IO *parse_argv(int argc, char **argv, char options[SIZEOF_OPTIONS])
+// Holds the command being run, reset once it is done
+static struct arena ast_arena;
+
+struct IO *parse_argv(int argc, char **argv, char options[SIZEOF_OPTIONS],
+                      char **path)
 {
     int index = 1;
-    // Parse options and determine the input source
-    if (argc > 1)
+    // Parse options
+    for (; index < argc && strncmp(argv[index], "--", 2) == 0; ++index)
     {
         if (strcmp(argv[index], "--pretty-print") == 0)
         {
             printf("PRETTY-PRINT: Activated.\n");
             options[0] = 1;
-            ++index;
-            if (argc == index)
-            {
-                // if no argument besides options is given, use IO_STDIN
-                return IO_create(IO_STDIN, NULL);
-            }
         }
-        if (strcmp(argv[index], "-c") == 0)
+        else if (strcmp(argv[index], "--no-prefetch") == 0)
         {
-            // if "-c" is specified, it means the next string is the input
-            return IO_create(IO_STRING, argv[index + 1]);
+            // must be known before the input is opened
+            options[1] = 1;
+            IO_set_prefetch(0);
         }
-        else
+        else if (strcmp(argv[index], "--pretokenize") == 0)
+            options[2] = 1;
+        else if (strcmp(argv[index], "--cache") == 0)
+            options[3] = 1;
+        else if (strcmp(argv[index], "--bytecode") == 0)
+            options[4] = 1;
+        else if (strcmp(argv[index], "--parse-only") == 0)
+            options[5] = 1;
+        else if (strcmp(argv[index], "--dump-ast") == 0)
         {
-            // otherwise, the input is the file
-            if (fopen(argv[index], "r"))
-                return IO_create(IO_FILE, argv[index]);
-            else
-                return NULL;
+            options[5] = 1;
+            options[6] = 1;
         }
+        else
+            return NULL;
     }
-    else
+
+    // Determine the input source
+    if (index == argc)
     {
-        // if no argument is given, use IO_STDIN
+        // if no argument besides options is given, use IO_STDIN
         return IO_create(IO_STDIN, NULL);
     }
+    else if (strcmp(argv[index], "-c") == 0)
+    {
+        // if "-c" is specified, it means the next string is the input
+        return IO_create(IO_STRING, argv[index + 1]);
+    }
+    else
+    {
+        // otherwise, the input is the file (NULL if it cannot be opened)
+        *path = argv[index];
+        return IO_create(IO_FILE, argv[index]);
+    }
 }
 
-static int cleanup_and_exit(struct token next, struct lexer *lexer,
-                            int exit_code)
+static int cleanup_and_exit(struct lexer *lexer, int exit_code)
 {
-    token_free(next);
     lexer_free(lexer);
     hash_variable_destroy();
     hash_function_destroy();
+    ast_exec_destroy();
+    arena_destroy(&ast_arena);
     return exit_code;
 }
 
+// Runs a parsed unit. Returns 1 if the shell must exit with *exit_code.
+static int run_ast(struct ast *ast, char options[SIZEOF_OPTIONS],
+                   int *exit_code)
+{
+    // optional pretty print
+    if (options[0])
+        ast_print(ast, 0);
+
+    // Execute the AST, compiled first with --bytecode
+    *exit_code = options[4] ? ast_vm_exec(ast) : ast_exec(ast);
+    if (*exit_code == EC_COMMAND_NOT_FOUND)
+    {
+        fprintf(stderr, "Error: Command not found.\n");
+    }
+    else if (EC_EXIT_MIN <= *exit_code && *exit_code <= EC_EXIT_MAX)
+    {
+        // fprintf(stderr, "exit with code %i\n", exit_code -
+        // EC_EXIT_MIN);
+        *exit_code -= EC_EXIT_MIN;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Parses a whole script at once, without moving the cursor of io
+static int parse_io(struct script *script, struct IO *io)
+{
+    struct IO *view = IO_create_view(io, 0);
+    struct lexer *lexer = view == NULL ? NULL : lexer_new(view);
+    if (lexer == NULL)
+    {
+        IO_free(view);
+        return 0;
+    }
+
+    int ok = parse_script(script, lexer);
+    lexer_free(lexer);
+    return ok;
+}
+
+// Runs the units of a script parsed at once
+static int run_script(struct lexer *lexer, struct script *script,
+                      char options[SIZEOF_OPTIONS])
+{
+    int exit_code = 0;
+    for (size_t i = 0; i < script->nb_asts && !current_42sh_is_a_fork(); ++i)
+    {
+        struct ast *ast = script->asts[i];
+        script->asts[i] = NULL;
+
+        int exiting = run_ast(ast, options, &exit_code);
+        ast_free(ast);
+        if (exiting)
+        {
+            script_free(script);
+            return cleanup_and_exit(lexer, exit_code);
+        }
+    }
+
+    script_free(script);
+    return cleanup_and_exit(lexer,
+                            exit_code < 0 ? -exit_code : exit_code);
+}
+
 int main(int argc, char **argv)
 {
-    // options[0] == pretty print
+    // options[0] == pretty print, options[1] == no prefetch,
+    // options[2] == pretokenize, options[3] == cache,
+    // options[4] == bytecode, options[5] == parse only, options[6] == dump ast
     char options[SIZEOF_OPTIONS] = { 0 };
-    struct IO *io = parse_argv(argc, argv, options);
+    char *path = NULL;
+    struct IO *io = parse_argv(argc, argv, options, &path);
     if (io == NULL)
     {
-        fprintf(stderr, "Usage: %s [--pretty-print] [-c] [input]\n", argv[0]);
+        fprintf(stderr,
+                "Usage: %s [--pretty-print] [--no-prefetch] "
+                "[--pretokenize] [--cache] [--bytecode] [--parse-only] "
+                "[--dump-ast] [-c] [input]\n",
+                argv[0]);
+        return -EC_UNKNOWN;
+    }
+
+    // Commands are resolved to the builtins as soon as they are parsed
+    if (!ast_exec_init())
+    {
+        fprintf(stderr, "Error: Builtins initialization failed.\n");
+        IO_free(io);
+        ast_exec_destroy();
         return -EC_UNKNOWN;
     }
 
+    // The input is only lexed and parsed, to measure the front-end
+    if (options[5])
+    {
+        int exit_code = parse_only(io, options[6], options[2]);
+        ast_exec_destroy();
+        return exit_code;
+    }
+
     // Initialize lexer with the input
     struct lexer *lexer = lexer_new(io);
     if (lexer == NULL)
@@ -79,6 +190,25 @@ int main(int argc, char **argv)
     // Initialize shell variables
     shell_variables_init();
 
+    // With --cache, scripts are run from the cache, or parsed at once to fill
+    // it: on a miss, nothing runs before the whole script is parsed
+    if (path != NULL && options[3] && cache_supports(io))
+    {
+        struct script script = { .asts = NULL };
+        if (cache_load(&script, path, io))
+            return run_script(lexer, &script, options);
+        if (parse_io(&script, io))
+        {
+            cache_store(&script, path, io);
+            return run_script(lexer, &script, options);
+        }
+    }
+
+    // Big scripts are lexed ahead on other threads, with --pretokenize only:
+    // no machine it was measured on ran faster with them
+    if (options[2])
+        lexer_pretokenize(lexer);
+
     // While we have lines to lex, parse, and execute, do so.
     int exit_code = 0;
     struct token next = lexer_peek(lexer);
@@ -89,39 +219,30 @@ int main(int argc, char **argv)
         struct ast *ast = NULL;
 
         // Parse input, check for parsing errors
-        if (parse_input(&ast, lexer) != PARSER_OK)
+        ast_set_arena(&ast_arena);
+        enum parser_status status = parse_input(&ast, lexer);
+        ast_set_arena(NULL);
+        if (status != PARSER_OK)
         {
             fprintf(stderr, "Error: Parsing failed\n");
-            return cleanup_and_exit(next, lexer, -EC_SYNTAX);
+            return cleanup_and_exit(lexer, -EC_SYNTAX);
         }
 
-        if (ast != NULL)
+        if (ast != NULL && run_ast(ast, options, &exit_code))
         {
-            // optional pretty print
-            if (options[0])
-                ast_print(ast, 0);
-
-            // Execute the AST
-            exit_code = ast_exec(ast);
-            if (exit_code == EC_COMMAND_NOT_FOUND)
-            {
-                fprintf(stderr, "Error: Command not found.\n");
-            }
-            else if (EC_EXIT_MIN <= exit_code && exit_code <= EC_EXIT_MAX)
-            {
-                ast_free(ast);
-                // fprintf(stderr, "exit with code %i\n", exit_code -
-                // EC_EXIT_MIN);
-                return cleanup_and_exit(next, lexer, exit_code - EC_EXIT_MIN);
-            }
+            ast_free(ast);
+            return cleanup_and_exit(lexer, exit_code);
         }
 
         ast_free(ast);
-        token_free(next);
+        arena_reset(&ast_arena);
+
+        // The unit has been executed, its input and tokens are not needed
+        lexer_release(lexer);
         next = lexer_peek(lexer);
     }
 
     // fprintf(stderr, "return with code %i\n", exit_code);
-    return cleanup_and_exit(next, lexer,
+    return cleanup_and_exit(lexer,
                             exit_code < 0 ? -exit_code : exit_code);
 }
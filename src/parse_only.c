@@ -0,0 +1,204 @@
+#include "parse_only.h"
+
+#include <stdio.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif /* __GLIBC__ */
+
+#include "exit_codes.h"
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+
+#define PAGE_SIZE 4096 // Stride at which a mapped input is touched
+
+struct phase
+{
+    const char *name;
+    double seconds;
+    size_t heap; // Bytes of the heap it holds once done
+    size_t count; // What it went through, in units
+    const char *unit;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Bytes of the heap in use, 0 where the C library does not tell
+static size_t heap_in_use(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+// Bytes the heap grew by since it held start bytes
+static size_t heap_since(size_t start)
+{
+    size_t heap = heap_in_use();
+    return heap > start ? heap - start : 0;
+}
+
+// Brings the whole input in memory, each page of a mapped file included
+static size_t read_input(struct IO *io)
+{
+    volatile char sink = 0;
+    size_t len;
+    const char *data = IO_run(io, &len);
+    while (len > 0)
+    {
+        for (size_t i = 0; i < len; i += PAGE_SIZE)
+            sink ^= data[i];
+        IO_skip(io, len);
+        data = IO_run(io, &len);
+    }
+    (void)sink;
+
+    return IO_tell(io);
+}
+
+// A lexer of the whole input, which read_input brought in memory
+static struct lexer *lexer_of(struct IO *io, int pretokenize)
+{
+    struct IO *view = IO_create_buffer(io->buffer, io->size);
+    struct lexer *lexer = view == NULL ? NULL : lexer_new(view);
+    if (lexer == NULL)
+    {
+        IO_free(view);
+        return NULL;
+    }
+
+    if (pretokenize)
+        lexer_pretokenize(lexer);
+    return lexer;
+}
+
+// Lexes the whole input, the tokens are kept until lexer is freed
+static size_t lex_all(struct lexer *lexer)
+{
+    lexer->quiet = 1;
+    size_t nb_tokens = 0;
+    struct token tok;
+    do
+    {
+        tok = lexer_pop(lexer);
+        ++nb_tokens;
+    } while (tok.type != TOKEN_EOF && tok.type != TOKEN_ERROR);
+
+    return nb_tokens;
+}
+
+static size_t count_nodes(const struct ast *ast)
+{
+    if (ast == NULL)
+        return 0;
+
+    size_t nb_nodes = 1;
+    for (size_t i = 0; i < ast->nb_sons; ++i)
+        nb_nodes += count_nodes(ast->sons[i]);
+    return nb_nodes;
+}
+
+// Parses the input unit by unit until its error, which is printed
+static void print_parse_error(struct IO *io)
+{
+    struct lexer *lexer = lexer_of(io, 0);
+    struct arena arena;
+    arena_init(&arena);
+    struct arena *previous = ast_set_arena(&arena);
+
+    struct token next = lexer == NULL ? (struct token){ .type = TOKEN_EOF }
+                                      : lexer_peek(lexer);
+    while (next.type != TOKEN_EOF && next.type != TOKEN_ERROR)
+    {
+        struct ast *ast = NULL;
+        if (parse_input(&ast, lexer) != PARSER_OK)
+            break;
+        arena_reset(&arena);
+        lexer_release(lexer);
+        next = lexer_peek(lexer);
+    }
+
+    ast_set_arena(previous);
+    arena_destroy(&arena);
+    lexer_free(lexer);
+    fprintf(stderr, "Error: Parsing failed\n");
+}
+
+static void print_phases(const struct phase *phases, size_t nb_phases)
+{
+    fprintf(stderr, "%-8s %12s %12s %12s %-7s %14s\n", "phase", "time(ms)",
+            "heap(KiB)", "count", "unit", "rate(/s)");
+
+    double total = 0;
+    for (size_t i = 0; i < nb_phases; ++i)
+    {
+        const struct phase *phase = &phases[i];
+        double rate = phase->seconds > 0 ? phase->count / phase->seconds : 0;
+        fprintf(stderr, "%-8s %12.3f %12.1f %12zu %-7s %14.0f\n", phase->name,
+                phase->seconds * 1e3, phase->heap / 1024.0, phase->count,
+                phase->unit, rate);
+        total += phase->seconds;
+    }
+    fprintf(stderr, "%-8s %12.3f\n", "total", total * 1e3);
+}
+
+int parse_only(struct IO *io, int dump, int pretokenize)
+{
+    struct phase phases[] = {
+        { .name = "io", .unit = "bytes" },
+        { .name = "lex", .unit = "tokens" },
+        { .name = "parse", .unit = "nodes" },
+    };
+
+    size_t heap = heap_in_use();
+    double start = now();
+    phases[0].count = read_input(io);
+    phases[0].seconds = now() - start;
+    phases[0].heap = heap_since(heap);
+
+    heap = heap_in_use();
+    start = now();
+    struct lexer *lexer = lexer_of(io, pretokenize);
+    phases[1].count = lexer == NULL ? 0 : lex_all(lexer);
+    phases[1].seconds = now() - start;
+    phases[1].heap = heap_since(heap);
+    lexer_free(lexer);
+
+    //? The lexer is run again by the parser, its time is not counted twice
+    heap = heap_in_use();
+    start = now();
+    struct script script = { .asts = NULL };
+    lexer = lexer_of(io, pretokenize);
+    int ok = lexer != NULL && parse_script(&script, lexer);
+    phases[2].seconds = now() - start - phases[1].seconds;
+    if (phases[2].seconds < 0)
+        phases[2].seconds = 0;
+    lexer_free(lexer);
+    phases[2].heap = heap_since(heap);
+    for (size_t i = 0; i < script.nb_asts; ++i)
+        phases[2].count += count_nodes(script.asts[i]);
+
+    if (!ok)
+    {
+        print_parse_error(io);
+        IO_free(io);
+        return -EC_SYNTAX;
+    }
+
+    for (size_t i = 0; dump && i < script.nb_asts; ++i)
+        ast_print(script.asts[i], 0);
+    fflush(stdout);
+    print_phases(phases, sizeof(phases) / sizeof(*phases));
+
+    script_free(&script);
+    IO_free(io);
+    return 0;
+}
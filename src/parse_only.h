@@ -0,0 +1,18 @@
+#ifndef PARSE_ONLY_H
+#define PARSE_ONLY_H
+
+#include "IO_Backend/io.h"
+
+/*
+** \brief Lexes and parses the whole input without running it, and prints on
+** stderr what each phase of the front-end took: reading the input, lexing it
+** and parsing it, with their wall time, the heap they hold once done and
+** their throughput. With dump, the commands are printed on stdout.
+**
+** Each phase runs over the whole input on its own: the input is read first,
+** then lexed, then lexed and parsed again. The time of parsing is that pass
+** minus the time of lexing. Takes io, returns the exit code of the shell.
+*/
+int parse_only(struct IO *io, int dump, int pretokenize);
+
+#endif /* ! PARSE_ONLY_H */
@@ -2,6 +2,7 @@
 #include "parser.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "lexer/lexer.h"
 
@@ -39,34 +40,109 @@ static enum parser_status parse_redirection(struct ast **res,
 static enum parser_status parse_subshell(struct ast **res, struct lexer *lexer);
 static enum parser_status parse_funcdec(struct ast **res, struct lexer *lexer);
 static int is_redirection_token(struct token token);
-static char *get_var_name(char *str);
-static char *remove_and_free_first_x_chars(char *str, int x);
-static char *get_var_value(char *str);
+static char *get_var_name(const char *str);
+static char *get_var_value(const char *str, size_t len);
 // ==================================================================
 
+static int parser_quiet = 0;
+
+void parser_set_quiet(int quiet)
+{
+    parser_quiet = quiet;
+}
+
+int script_append(struct script *script, struct ast *ast)
+{
+    if (script->nb_asts == script->capacity)
+    {
+        size_t capacity = script->capacity ? 2 * script->capacity : 16;
+        struct ast **asts =
+            realloc(script->asts, capacity * sizeof(struct ast *));
+        if (asts == NULL)
+        {
+            fprintf(stderr, "script_append: realloc failed\n");
+            return 0;
+        }
+        script->asts = asts;
+        script->capacity = capacity;
+    }
+
+    script->asts[script->nb_asts++] = ast;
+    return 1;
+}
+
+void script_free(struct script *script)
+{
+    for (size_t i = 0; i < script->nb_asts; ++i)
+        ast_free(script->asts[i]);
+    free(script->asts);
+    script->asts = NULL;
+    script->nb_asts = 0;
+    script->capacity = 0;
+    arena_destroy(&script->arena);
+}
+
+int parse_script(struct script *script, struct lexer *lexer)
+{
+    lexer->quiet = 1;
+    parser_set_quiet(1);
+    struct arena *previous = ast_set_arena(&script->arena);
+
+    int ok = 1;
+    struct token next = lexer_peek(lexer);
+    while (ok && next.type != TOKEN_EOF)
+    {
+        struct ast *ast = NULL;
+        ok = next.type != TOKEN_ERROR && parse_input(&ast, lexer) == PARSER_OK
+            && lexer->nb_errors == 0;
+        if (ok && ast != NULL && !script_append(script, ast))
+        {
+            ast_free(ast);
+            ok = 0;
+        }
+
+        lexer_release(lexer);
+        next = lexer_peek(lexer);
+    }
+
+    ast_set_arena(previous);
+    parser_set_quiet(0);
+    lexer->quiet = 0;
+    ok = ok && lexer->nb_errors == 0;
+    if (!ok)
+        script_free(script);
+    return ok;
+}
+
 enum parser_status error_handling(struct ast **res, struct ast *other_free,
-                                  struct token *token, char *hint)
+                                  char *hint)
 {
     if (other_free)
         ast_free(other_free);
     if (res && *res)
         ast_free(*res);
-    if (token)
-        token_free(*token);
 
     *res = NULL;
-    fprintf(stderr, "Parser received an error. Hint: '%s'.\n", hint);
+    if (!parser_quiet)
+        fprintf(stderr, "Parser received an error. Hint: '%s'.\n", hint);
     return PARSER_UNEXPECTED_TOKEN;
 }
 
+// Tokens only live until the command is released, the AST keeps its own copy
+static char *pop_value(struct lexer *lexer)
+{
+    size_t len;
+    const char *text = lexer_token_text(lexer, lexer_pop(lexer), &len);
+    return ast_strndup(text, len);
+}
+
 static struct token discard_token_type_all(struct lexer *lexer,
                                            enum token_type discard_type)
 {
     struct token next = lexer_peek(lexer);
     if (next.type == discard_type)
     {
-        token_free(lexer_pop(lexer));
-        token_free(next);
+        lexer_pop(lexer);
         next = lexer_peek(lexer);
     }
     return next;
@@ -78,7 +154,7 @@ static int could_be_redir(struct token token)
     return type == TOKEN_REDIR_IN || type == TOKEN_REDIR_OUT
         || type == TOKEN_REDIR_APP_OUT || type == TOKEN_REDIR_DUP_IN
         || type == TOKEN_REDIR_DUP_OUT || type == TOKEN_REDIR_RW
-        || type == TOKEN_IONUMBER;
+        || type == TOKEN_HEREDOC || type == TOKEN_IONUMBER;
 }
 
 static int could_be_word(struct token token)
@@ -106,7 +182,7 @@ enum parser_status parse_input(struct ast **res, struct lexer *lexer)
         *res = NULL;
         // if we have not reached the end, then we must go to the next line
         if (next.type == TOKEN_LF)
-            token_free(lexer_pop(lexer));
+            lexer_pop(lexer);
     }
     // otherwise
     else
@@ -114,17 +190,18 @@ enum parser_status parse_input(struct ast **res, struct lexer *lexer)
         enum parser_status status = parse_list(res, lexer);
         if (status == PARSER_UNEXPECTED_TOKEN)
         {
-            return error_handling(res, NULL, &next, "parse_input");
+            return error_handling(res, NULL, "parse_input");
         }
-        token_free(next);
         next = lexer_peek(lexer);
         if (next.type != TOKEN_EOF && next.type != TOKEN_LF)
         {
-            return error_handling(res, NULL, &next,
-                                  "parse_input expected EOF or LF");
+            return error_handling(res, NULL, "parse_input expected EOF or LF");
         }
+        // consume the newline so that nothing of this line stays peeked
+        if (next.type == TOKEN_LF)
+            lexer_pop(lexer);
+        ast_resolve(*res);
     }
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -134,34 +211,31 @@ static enum parser_status parse_list(struct ast **res, struct lexer *lexer)
     struct token next = lexer_peek(lexer);
     if (next.type == TOKEN_LPAREN)
     {
-        token_free(next);
         return parse_command(res, lexer);
     }
     if (!could_be_word(next))
-        return error_handling(res, NULL, &next, "parse_list expected WORD");
+        return error_handling(res, NULL, "parse_list expected WORD");
 
     // create new ast node -> list of command
     struct ast *main = ast_new(AST_COMMAND_LIST, NULL);
     if (!main)
-        return error_handling(res, NULL, &next, "parse_list MEMORY");
+        return error_handling(res, NULL, "parse_list MEMORY");
     // while there is valid input
     while (could_be_word(next))
     {
         struct ast *sub = NULL;
         // parse individual command
         if (parse_and_or(&sub, lexer) != PARSER_OK)
-            return error_handling(res, main, &next, "parse_list");
+            return error_handling(res, main, "parse_list");
 
         // append the parsed command sub as a child of the last command list
         ast_append_son(main, sub);
 
         // check if the next token is ';'
-        token_free(next);
         next = lexer_peek(lexer);
         if (next.type == TOKEN_SEMI_COL)
         {
-            token_free(next);
-            token_free(lexer_pop(lexer));
+            lexer_pop(lexer);
             next = lexer_peek(lexer);
         }
         else
@@ -170,8 +244,6 @@ static enum parser_status parse_list(struct ast **res, struct lexer *lexer)
 
     // set result to the constructed list
     *res = main;
-    // free the last token peeked
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -181,7 +253,7 @@ static enum parser_status parse_and_or(struct ast **res, struct lexer *lexer)
     // parse first pipeline rule
     struct ast *current = NULL;
     if (parse_pipeline(&current, lexer) != PARSER_OK)
-        return error_handling(res, NULL, NULL, "parse_and_or");
+        return error_handling(res, NULL, "parse_and_or");
 
     // while there are and/or conditions
     struct token next = lexer_peek(lexer);
@@ -191,33 +263,29 @@ static enum parser_status parse_and_or(struct ast **res, struct lexer *lexer)
         struct ast *new =
             ast_new(next.type == TOKEN_AND ? AST_AND : AST_OR, NULL);
         if (!new)
-            return error_handling(res, current, &next, "parse_and_or MEMORY");
+            return error_handling(res, current, "parse_and_or MEMORY");
         ast_append_son(new, current);
 
         // remove any linefeeds
-        token_free(next);
-        token_free(lexer_pop(lexer));
+        lexer_pop(lexer);
         next = lexer_peek(lexer);
         while (next.type == TOKEN_LF)
         {
-            token_free(next);
-            token_free(lexer_pop(lexer));
+            lexer_pop(lexer);
             next = lexer_peek(lexer);
         }
 
         // parse the second son
         struct ast *second = NULL;
         if (parse_pipeline(&second, lexer) != PARSER_OK)
-            return error_handling(res, new, &next, "parse_and_or");
+            return error_handling(res, new, "parse_and_or");
         ast_append_son(new, second);
 
         current = new;
-        token_free(next);
         next = lexer_peek(lexer);
     }
 
     *res = current;
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -226,43 +294,38 @@ static enum parser_status helper_pipeline(struct ast **res, struct lexer *lexer)
     // parse first pipeline rule
     struct ast *current = NULL;
     if (parse_command(&current, lexer) != PARSER_OK)
-        return error_handling(res, NULL, NULL, "helper_pipeline");
+        return error_handling(res, NULL, "helper_pipeline");
 
     // while there are and/or conditions
     struct token next = lexer_peek(lexer);
     while (next.type == TOKEN_PIPE)
     {
-        token_free(lexer_pop(lexer));
+        lexer_pop(lexer);
         // build a new ast for the pipe, set its first son as the previous ast
         struct ast *new = ast_new(AST_PIPE, NULL);
         if (!new)
-            return error_handling(res, current, &next,
-                                  "helper_pipeline MEMORY");
+            return error_handling(res, current, "helper_pipeline MEMORY");
         ast_append_son(new, current);
 
         // remove any linefeeds
-        token_free(next);
         next = lexer_peek(lexer);
         while (next.type == TOKEN_LF)
         {
-            token_free(next);
-            token_free(lexer_pop(lexer));
+            lexer_pop(lexer);
             next = lexer_peek(lexer);
         }
 
         // parse the second son
         struct ast *second = NULL;
         if (parse_command(&second, lexer) != PARSER_OK)
-            return error_handling(res, new, &next, "helper_pipeline");
+            return error_handling(res, new, "helper_pipeline");
         ast_append_son(new, second);
 
         current = new;
-        token_free(next);
         next = lexer_peek(lexer);
     }
 
     *res = current;
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -273,23 +336,22 @@ static enum parser_status parse_pipeline(struct ast **res, struct lexer *lexer)
     struct token next = lexer_peek(lexer);
     if (next.type == TOKEN_NOT)
     {
-        token_free(lexer_pop(lexer));
+        lexer_pop(lexer);
         main = ast_new(AST_NOT, NULL);
         if (!main)
-            return error_handling(res, NULL, &next, "parse_pipeline MEMORY");
+            return error_handling(res, NULL, "parse_pipeline MEMORY");
         struct ast *sub = NULL;
         if (helper_pipeline(&sub, lexer) != PARSER_OK)
-            return error_handling(res, main, &next, "parse_pipeline");
+            return error_handling(res, main, "parse_pipeline");
         ast_append_son(main, sub);
     }
     else
     {
         if (helper_pipeline(&main, lexer) != PARSER_OK)
-            return error_handling(res, NULL, &next, "parse_pipeline");
+            return error_handling(res, NULL, "parse_pipeline");
     }
 
     *res = main;
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -299,8 +361,7 @@ helper_parse_command_shell_command(struct ast **res, struct lexer *lexer)
 {
     struct ast *shell_command = NULL;
     if (parse_shell_command(&shell_command, lexer) != PARSER_OK)
-        return error_handling(res, NULL, NULL,
-                              "helper_parse_command_shell_command");
+        return error_handling(res, NULL, "helper_parse_command_shell_command");
     struct ast *main = shell_command;
 
     // if a redirection follows the shell_command, we build the folder
@@ -313,7 +374,7 @@ helper_parse_command_shell_command(struct ast **res, struct lexer *lexer)
         {
             if ((redir_folder = ast_new(AST_REDIR_FOLDER, NULL)) == NULL)
                 return error_handling(
-                    res, shell_command, NULL,
+                    res, shell_command,
                     "helper_parse_command_shell_command MEMORY");
             ast_append_son(redir_folder, shell_command); // gets command
             main = redir_folder; // replaces command in res (final ast)
@@ -321,16 +382,14 @@ helper_parse_command_shell_command(struct ast **res, struct lexer *lexer)
         // add the redirection to the folder
         struct ast *redir = NULL;
         if (parse_redirection(&redir, lexer) != PARSER_OK)
-            return error_handling(res, redir_folder, NULL,
+            return error_handling(res, redir_folder,
                                   "helper_parse_command_shell_command");
         ast_append_son(redir_folder, redir);
 
-        token_free(next);
         next = lexer_peek(lexer);
     }
 
     *res = main;
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -340,7 +399,7 @@ static enum parser_status helper_parse_command_funcdec(struct ast **res,
 {
     struct ast *funcdec = NULL;
     if (parse_funcdec(&funcdec, lexer) != PARSER_OK)
-        return error_handling(res, NULL, NULL, "helper_parse_command_funcdec");
+        return error_handling(res, NULL, "helper_parse_command_funcdec");
 
     // if a redirection follows the funcdec, it is valid whenever func is called
     struct ast *redir_folder = NULL;
@@ -351,27 +410,32 @@ static enum parser_status helper_parse_command_funcdec(struct ast **res,
         if (redir_folder == NULL)
         {
             if ((redir_folder = ast_new(AST_REDIR_FOLDER, NULL)) == NULL)
-                return error_handling(res, funcdec, NULL,
+                return error_handling(res, funcdec,
                                       "helper_parse_command_funcdec MEMORY");
             ast_append_son(redir_folder, ast_get_son(funcdec, 0)); // gets body
-            funcdec->left_son = redir_folder; // swaps son (nb_sons stays same)
+            funcdec->sons[0] = redir_folder; // swaps son (nb_sons stays same)
         }
         // add the redirection to the folder
         struct ast *redir = NULL;
         if (parse_redirection(&redir, lexer) != PARSER_OK)
-            return error_handling(res, funcdec, NULL,
-                                  "helper_parse_command_funcdec");
+            return error_handling(res, funcdec, "helper_parse_command_funcdec");
         ast_append_son(redir_folder, redir);
 
-        token_free(next);
         next = lexer_peek(lexer);
     }
 
     *res = funcdec;
-    token_free(next);
     return PARSER_OK;
 }
 
+// funcdec = WORD '(' ')' ...
+static int starts_funcdec(struct lexer *lexer)
+{
+    return lexer_peek(lexer).type == TOKEN_WORD
+        && lexer_peek_nth(lexer, 2).type == TOKEN_LPAREN
+        && lexer_peek_nth(lexer, 3).type == TOKEN_RPAREN;
+}
+
 static int starts_shell_command(struct token token)
 {
     enum token_type type = token.type;
@@ -387,19 +451,16 @@ static int starts_shell_command(struct token token)
 static enum parser_status parse_command(struct ast **res, struct lexer *lexer)
 {
     struct token next = lexer_peek(lexer);
-    if (next.type == TOKEN_FUNCTION_WORD)
+    if (starts_funcdec(lexer))
     {
-        token_free(next);
         return helper_parse_command_funcdec(res, lexer);
     }
     else if (starts_shell_command(next))
     {
-        token_free(next);
         return helper_parse_command_shell_command(res, lexer);
     }
     else
     {
-        token_free(next);
         return parse_simple_command(res, lexer);
     }
 }
@@ -418,77 +479,70 @@ static enum parser_status parse_shell_command(struct ast **res,
     struct token next = lexer_peek(lexer);
     if (next.type == TOKEN_LBRACKET)
     {
-        token_free(next);
-        token_free(lexer_pop(lexer));
+        lexer_pop(lexer);
         if (parse_compound_list(res, lexer) != PARSER_OK)
-            return error_handling(res, NULL, NULL, "parse_command");
+            return error_handling(res, NULL, "parse_command");
         next = lexer_peek(lexer);
         if (next.type != TOKEN_RBRACKET)
-            return error_handling(res, NULL, &next,
-                                  "parse_command expected RBRACKET");
-        token_free(next);
-        token_free(lexer_pop(lexer));
+            return error_handling(res, NULL, "parse_command expected RBRACKET");
+        lexer_pop(lexer);
         return PARSER_OK;
     }
     else if (next.type == TOKEN_LPAREN)
     {
-        token_free(next);
         return parse_subshell(res, lexer);
     }
     else if (next.type == TOKEN_IF)
     {
-        token_free(next);
         return parse_rule_if(res, lexer);
     }
     else if (next.type == TOKEN_WHILE || next.type == TOKEN_UNTIL)
     {
-        token_free(next);
         return parse_while_until(res, lexer);
     }
     else if (next.type == TOKEN_FOR)
     {
-        token_free(next);
         return parse_for(res, lexer);
     }
     else
-        return error_handling(res, NULL, &next,
-                              "parse_command expected something");
+        return error_handling(res, NULL, "parse_command expected something");
 }
 
 static enum parser_status parse_assignment(struct ast **res,
                                            struct lexer *lexer)
 {
     struct token next = lexer_peek(lexer);
+    size_t len;
+    const char *text = lexer_token_text(lexer, next, &len);
     //= Get the variable name
     char *name;
-    if (next.first == NULL)
-        name = get_var_name(next.value);
+    if (next.nb_segments == 0)
+        name = get_var_name(text);
     else
     {
-        name = get_var_name(next.first->value);
-        next.first->value =
-            remove_and_free_first_x_chars(next.first->value, strlen(name) + 1);
+        name = get_var_name(next.segments[0].value);
+        // the value lives in the lexer arena: skip the name, do not free it
+        next.segments[0].value += strlen(name) + 1;
     }
     struct ast *main = ast_new(AST_VARIABLE, name);
 
     //= Get the variable value
     struct ast *sub = NULL;
-    if (next.first == NULL)
-        sub = ast_new(AST_ARGUMENT, get_var_value(next.value));
+    if (next.nb_segments == 0)
+        sub = ast_new(AST_ARGUMENT, get_var_value(text, len));
     else
         sub = handle_expandable_token(next);
 
     if (!main || !sub)
         return error_handling(
-            res, NULL, &next,
+            res, NULL,
             "parse_simple_command (variable assignment) MEMORY");
 
     ast_append_son(main, sub);
 
-    token_free(lexer_pop(lexer)); // Consume the assignment word
+    lexer_pop(lexer); // Consume the assignment word
 
     *res = main;
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -505,12 +559,12 @@ static enum parser_status parse_simple_command(struct ast **res,
     struct token next = lexer_peek(lexer);
     if (!could_be_word(next) && !could_be_redir(next))
         return error_handling(
-            res, NULL, &next,
+            res, NULL,
             "parse_simple_command expected WORD, ASSIGMENT_WORD or REDIR");
 
     struct ast *command_list = ast_new(AST_COMMAND_LIST, NULL);
     if (!command_list)
-        return error_handling(res, NULL, &next, "parse_simple_command MEMORY");
+        return error_handling(res, NULL, "parse_simple_command MEMORY");
     struct ast *redir_folder = NULL;
     while (could_be_redir(next) || next.type == TOKEN_ASSIGNMENT_WORD)
     { // { assignment | redirection }
@@ -520,7 +574,7 @@ static enum parser_status parse_simple_command(struct ast **res,
             if (parse_assignment(&sub, lexer) != PARSER_OK)
                 return error_handling(
                     res, redir_folder == NULL ? command_list : redir_folder,
-                    NULL, "helper_parse_command_funcdec MEMORY");
+                    "helper_parse_command_funcdec MEMORY");
             ast_append_son(command_list, sub);
         }
         else // redirection
@@ -530,23 +584,21 @@ static enum parser_status parse_simple_command(struct ast **res,
             {
                 if ((redir_folder = ast_new(AST_REDIR_FOLDER, NULL)) == NULL)
                     return error_handling(
-                        res, command_list, NULL,
+                        res, command_list,
                         "helper_parse_command_funcdec MEMORY");
                 ast_append_son(redir_folder, command_list); // gets command list
             }
             // add the redirection to the folder
             struct ast *redir = NULL;
             if (parse_redirection(&redir, lexer) != PARSER_OK)
-                return error_handling(res, redir_folder, NULL,
+                return error_handling(res, redir_folder,
                                       "helper_parse_command_funcdec");
             ast_append_son(redir_folder, redir);
         }
 
-        token_free(next);
         next = lexer_peek(lexer);
     }
 
-    token_free(next);
     return parse_simple_command2(res, lexer, command_list, redir_folder);
 }
 
@@ -559,15 +611,13 @@ static enum parser_status parse_simple_command2(struct ast **res,
     if (!could_be_word(next))
     { // if there is no command, return
         *res = redir_folder == NULL ? command_list : redir_folder;
-        token_free(next);
         return PARSER_OK;
     }
-    struct ast *main = ast_new(AST_COMMAND, lexer_pop(lexer).value);
+    struct ast *main = ast_new(AST_COMMAND, pop_value(lexer));
     if (!main)
-        return error_handling(res, NULL, NULL, "parse_simple_command MEMORY");
+        return error_handling(res, NULL, "parse_simple_command MEMORY");
     ast_append_son(command_list, main);
 
-    token_free(next);
     next = lexer_peek(lexer);
     while (could_be_word(next) || is_redirection_token(next))
     {
@@ -577,7 +627,7 @@ static enum parser_status parse_simple_command2(struct ast **res,
             if (parse_element(&sub, lexer) == PARSER_UNEXPECTED_TOKEN)
                 return error_handling(
                     res, redir_folder == NULL ? command_list : redir_folder,
-                    &next, "parse_simple_command");
+                    "parse_simple_command");
             ast_append_son(main, sub);
         }
         else // redirection
@@ -587,24 +637,22 @@ static enum parser_status parse_simple_command2(struct ast **res,
             {
                 if ((redir_folder = ast_new(AST_REDIR_FOLDER, NULL)) == NULL)
                     return error_handling(
-                        res, command_list, NULL,
+                        res, command_list,
                         "helper_parse_command_funcdec MEMORY");
                 ast_append_son(redir_folder, command_list); // gets command list
             }
             // add the redirection to the folder
             struct ast *redir = NULL;
             if (parse_redirection(&redir, lexer) != PARSER_OK)
-                return error_handling(res, redir_folder, NULL,
+                return error_handling(res, redir_folder,
                                       "helper_parse_command_funcdec");
             ast_append_son(redir_folder, redir);
         }
 
-        token_free(next);
         next = lexer_peek(lexer);
     }
 
     *res = redir_folder == NULL ? command_list : redir_folder;
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -617,7 +665,7 @@ static enum parser_status parse_element(struct ast **res, struct lexer *lexer)
 {
     struct token next = lexer_peek(lexer);
     if (!could_be_word(next))
-        return error_handling(res, NULL, &next, "parse_element expected WORD");
+        return error_handling(res, NULL, "parse_element expected WORD");
 
     struct ast *main;
 
@@ -627,19 +675,16 @@ static enum parser_status parse_element(struct ast **res, struct lexer *lexer)
         struct token tok = lexer_pop(lexer);
         main = handle_expandable_token(tok);
         if (!main)
-            return error_handling(res, NULL, &next, "parse_element MEMORY");
-
-        token_free(tok);
+            return error_handling(res, NULL, "parse_element MEMORY");
     }
     else
     {
-        main = ast_new(AST_ARGUMENT, lexer_pop(lexer).value);
+        main = ast_new(AST_ARGUMENT, pop_value(lexer));
         if (!main)
-            return error_handling(res, NULL, &next, "parse_element MEMORY");
+            return error_handling(res, NULL, "parse_element MEMORY");
     }
 
     *res = main;
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -653,6 +698,7 @@ static int is_redirection_token(struct token token)
     case TOKEN_REDIR_DUP_OUT:
     case TOKEN_REDIR_DUP_IN:
     case TOKEN_REDIR_RW:
+    case TOKEN_HEREDOC:
     case TOKEN_IONUMBER:
         return 1; // True, this is a redirection token
     default:
@@ -660,46 +706,23 @@ static int is_redirection_token(struct token token)
     }
 }
 
-static char *get_var_name(char *str)
+static char *get_var_name(const char *str)
 {
-    char *name = calloc(1, strlen(str) + 1);
-    if (!name)
-        return NULL;
-
     size_t i = 0;
     while (str[i] != '=')
-    {
-        name[i] = str[i];
         ++i;
-    }
-    name[i] = '\0';
-    return name;
-}
-
-static char *remove_and_free_first_x_chars(char *str, int x)
-{
-    char *new_str = strdup(str + x);
-    free(str);
-    return new_str;
+    return ast_strndup(str, i);
 }
 
-static char *get_var_value(char *str)
+static char *get_var_value(const char *str, size_t len)
 {
-    char *value = calloc(1, strlen(str) + 1);
-    if (!value)
-        return NULL;
-
     //? Skip the variable name
     size_t i = 0;
     while (str[i] != '=')
         ++i;
     ++i;
     //? Copy the variable value
-    size_t u = 0;
-    while (str[i] != '\0')
-        value[u++] = str[i++];
-    value[u] = '\0';
-    return value;
+    return ast_strndup(str + i, len - i);
 }
 
 static enum parser_status parse_for_first(struct ast **res, struct lexer *lexer,
@@ -708,60 +731,54 @@ static enum parser_status parse_for_first(struct ast **res, struct lexer *lexer,
     struct token next = lexer_peek(lexer);
     if (next.type != TOKEN_FOR)
     {
-        return error_handling(res, NULL, &next, "parse_for expected 'for'");
+        return error_handling(res, NULL, "parse_for expected 'for'");
     }
-    token_free(lexer_pop(lexer)); // Consume 'for'
-    token_free(next);
+    lexer_pop(lexer); // Consume 'for'
     next = lexer_peek(lexer);
     if (!could_be_word(next))
     {
-        return error_handling(res, NULL, &next,
-                              "parse_for expected variable name");
+        return error_handling(res, NULL, "parse_for expected variable name");
     }
-    *var_name = next.value; // Consume variable name
-    token_free(lexer_pop(lexer));
+    *var_name = pop_value(lexer); // Consume variable name
 
     *list = ast_new(AST_COMMAND_LIST, NULL);
     if (!*list)
     {
-        free(*var_name);
-        return error_handling(res, NULL, &next,
+        ast_free_value(*var_name);
+        return error_handling(res, NULL,
                               "parse_for memory allocation failed for list");
     }
 
     next = lexer_peek(lexer);
     if (next.type == TOKEN_IN)
     {
-        token_free(lexer_pop(lexer)); // Consume 'in'
-        token_free(next);
+        lexer_pop(lexer); // Consume 'in'
         next = lexer_peek(lexer);
         while (could_be_word(next))
         {
-            struct ast *item = ast_new(AST_ARGUMENT, lexer_pop(lexer).value);
-            if (!item)
+            // The words are expanded as the arguments of a command are
+            struct ast *item = NULL;
+            if (parse_element(&item, lexer) != PARSER_OK)
             {
-                free(*var_name);
-                return error_handling(res, *list, &next,
+                ast_free_value(*var_name);
+                return error_handling(res, *list,
                                       "parse_for memory allocation failed");
             }
             ast_append_son(*list, item);
-            token_free(next);
             next = lexer_peek(lexer);
         }
     }
-    token_free(next);
     return PARSER_OK;
 }
 
 static enum parser_status handle_for_error(char *var_name, struct ast *list,
-                                           struct ast *compound_list,
-                                           struct token *next)
+                                           struct ast *compound_list)
 {
     if (var_name)
     {
-        free(var_name);
+        ast_free_value(var_name);
     }
-    return error_handling(&compound_list, list, next, "parse_for error");
+    return error_handling(&compound_list, list, "parse_for error");
 }
 
 // rule_for = 'for' WORD ( [';'] | [ {'\n'} 'in' { WORD } ( ';' | '\n' ) ] )
@@ -781,43 +798,39 @@ static enum parser_status parse_for(struct ast **res, struct lexer *lexer)
     // Skip new lines before 'do'
     while (next.type == TOKEN_LF || next.type == TOKEN_SEMI_COL)
     {
-        token_free(lexer_pop(lexer));
-        token_free(next);
+        lexer_pop(lexer);
         next = lexer_peek(lexer);
     }
 
     if (next.type != TOKEN_DO)
-        return handle_for_error(var_name, list, NULL, &next);
+        return handle_for_error(var_name, list, NULL);
 
-    token_free(lexer_pop(lexer)); // Consume 'do'
-    token_free(next);
+    lexer_pop(lexer); // Consume 'do'
 
     // Skip new lines before processing compound list
     next = lexer_peek(lexer);
     while (next.type == TOKEN_LF || next.type == TOKEN_SEMI_COL)
     {
-        token_free(lexer_pop(lexer));
-        token_free(next);
+        lexer_pop(lexer);
         next = lexer_peek(lexer);
     }
 
     if (parse_compound_list(&compound_list, lexer) != PARSER_OK)
     {
-        return handle_for_error(var_name, list, NULL, &next);
+        return handle_for_error(var_name, list, NULL);
     }
 
-    token_free(next);
     next = lexer_peek(lexer);
     if (next.type != TOKEN_DONE)
     {
-        return handle_for_error(var_name, list, compound_list, &next);
+        return handle_for_error(var_name, list, compound_list);
     }
 
-    token_free(lexer_pop(lexer)); // Consume 'done'
+    lexer_pop(lexer); // Consume 'done'
 
     struct ast *for_node = ast_new(AST_FOR, var_name);
     if (!for_node)
-        return handle_for_error(var_name, list, compound_list, NULL);
+        return handle_for_error(var_name, list, compound_list);
 
     ast_append_son(for_node, list);
     ast_append_son(for_node, compound_list);
@@ -826,7 +839,6 @@ static enum parser_status parse_for(struct ast **res, struct lexer *lexer)
     var_name = NULL;
     list = NULL;
     compound_list = NULL;
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -846,6 +858,8 @@ static enum ast_type get_ast_type_from_token(enum token_type t_type)
         return AST_REDIR_DUP_OUT;
     case TOKEN_REDIR_RW:
         return AST_REDIR_RW;
+    case TOKEN_HEREDOC:
+        return AST_REDIR_HEREDOC;
     default:
         return AST_INVALID; // invalid type
     }
@@ -856,25 +870,22 @@ static struct ast *handle_expandable_token(struct token token)
     struct ast *main = ast_new(AST_EXPANSION, NULL);
     if (!main)
         return NULL;
-    struct expansion *head = token.first;
-    while (head)
+    for (size_t i = 0; i < token.nb_segments; ++i)
     {
+        struct segment *segment = &token.segments[i];
         // Copy the value
-        char *val = calloc(1, strlen(head->value) + 1);
-        val = strcpy(val, head->value);
-        val[strlen(head->value)] = '\0';
+        char *val = ast_strndup(segment->value, strlen(segment->value));
 
         // Create the ast node
         struct ast *sub = ast_new(
-            head->type == NORMAL ? AST_EXPARG_NORM : AST_EXPARG_DQ, val);
-        if (!sub)
+            segment->type == NORMAL ? AST_EXPARG_NORM : AST_EXPARG_DQ, val);
+        if (!sub || !ast_append_son(main, sub))
         {
             fprintf(stderr, "handle_expandable_token MEMORY\n");
+            ast_free(sub);
             ast_free(main);
             return NULL;
         }
-        ast_append_son(main, sub);
-        head = head->next;
     }
     return main;
 }
@@ -883,44 +894,38 @@ static enum parser_status helper_parse_if(struct ast **res, struct lexer *lexer)
 {
     struct ast *main = ast_new(AST_CONDITIONAL, NULL);
     if (!main)
-        return error_handling(res, NULL, NULL, "helper_parse_if MEMORY");
+        return error_handling(res, NULL, "helper_parse_if MEMORY");
 
     // compound_list
     struct ast *sub = NULL;
     if (parse_compound_list(&sub, lexer) == PARSER_UNEXPECTED_TOKEN)
-        return error_handling(res, main, NULL, "helper_parse_if");
+        return error_handling(res, main, "helper_parse_if");
     ast_append_son(main, sub);
 
     // then
     struct token next = lexer_peek(lexer);
     if (next.type != TOKEN_THEN)
-        return error_handling(res, main, &next,
-                              "helper_parse_if expected THEN");
+        return error_handling(res, main, "helper_parse_if expected THEN");
     else
-    {
-        token_free(next);
-        next = lexer_pop(lexer);
-    }
+        lexer_pop(lexer);
 
     // compound_list
     sub = NULL;
     if (parse_compound_list(&sub, lexer) == PARSER_UNEXPECTED_TOKEN)
-        return error_handling(res, main, &next, "helper_parse_if");
+        return error_handling(res, main, "helper_parse_if");
     ast_append_son(main, sub);
 
     // optional else_clause
-    token_free(next);
     next = lexer_peek(lexer);
     if (next.type == TOKEN_ELSE || next.type == TOKEN_ELIF)
     {
         sub = NULL;
         if (parse_else_clause(&sub, lexer) == PARSER_UNEXPECTED_TOKEN)
-            return error_handling(res, main, &next, "helper_parse_if");
+            return error_handling(res, main, "helper_parse_if");
         ast_append_son(main, sub);
     }
 
     *res = main;
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -930,22 +935,20 @@ static enum parser_status parse_rule_if(struct ast **res, struct lexer *lexer)
     // if
     struct token next = lexer_peek(lexer);
     if (next.type != TOKEN_IF)
-        return error_handling(res, NULL, &next, "parse_rule_if expected IF");
-    token_free(lexer_pop(lexer));
+        return error_handling(res, NULL, "parse_rule_if expected IF");
+    lexer_pop(lexer);
 
     // inside
     if (helper_parse_if(res, lexer) == PARSER_UNEXPECTED_TOKEN)
-        return error_handling(res, NULL, &next, "parse_rule_if");
+        return error_handling(res, NULL, "parse_rule_if");
 
     // fi
-    token_free(next);
     next = lexer_peek(lexer);
     if (next.type != TOKEN_FI)
-        return error_handling(res, NULL, &next, "parse_rule_if expected FI");
+        return error_handling(res, NULL, "parse_rule_if expected FI");
     else
-        token_free(lexer_pop(lexer));
+        lexer_pop(lexer);
 
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -959,19 +962,16 @@ static enum parser_status parse_else_clause(struct ast **res,
     struct token next = lexer_peek(lexer);
     if (next.type == TOKEN_ELSE)
     {
-        token_free(next);
-        token_free(lexer_pop(lexer));
+        lexer_pop(lexer);
         return parse_compound_list(res, lexer);
     }
     else if (next.type == TOKEN_ELIF)
     {
-        token_free(next);
-        token_free(lexer_pop(lexer));
+        lexer_pop(lexer);
         return helper_parse_if(res, lexer);
     }
     else
     {
-        token_free(next);
         return PARSER_UNEXPECTED_TOKEN;
     }
 }
@@ -991,28 +991,25 @@ static enum parser_status parse_compound_list(struct ast **res,
 {
     struct token next = discard_token_type_all(lexer, TOKEN_LF);
     if (!could_be_word(next))
-        return error_handling(res, NULL, &next,
-                              "parse_compound_list expected WORD");
+        return error_handling(res, NULL, "parse_compound_list expected WORD");
 
     // create new ast node -> list of command
     struct ast *main = ast_new(AST_COMMAND_LIST, NULL);
     if (!main)
-        return error_handling(res, NULL, &next, "parse_compound_list MEMORY");
+        return error_handling(res, NULL, "parse_compound_list MEMORY");
 
     // get first (and mandatory) and_or rule
     struct ast *sub = NULL;
     if (parse_and_or(&sub, lexer) != PARSER_OK)
-        return error_handling(res, main, &next, "parse_compound_list");
+        return error_handling(res, main, "parse_compound_list");
     ast_append_son(main, sub);
 
-    token_free(next);
     next = lexer_peek(lexer);
     // as long as there MIGHT be other and_or rules
     while (next.type == TOKEN_SEMI_COL || next.type == TOKEN_LF)
     {
         // handle starting or ending ( ';' | '\n' ) { '\n' }
-        token_free(lexer_pop(lexer));
-        token_free(next);
+        lexer_pop(lexer);
         next = discard_token_type_all(lexer, TOKEN_LF);
 
         // check if the compound list actually ends here LMAO
@@ -1020,25 +1017,22 @@ static enum parser_status parse_compound_list(struct ast **res,
             break;
 
         if (!could_be_word(next))
-            return error_handling(res, main, &next,
+            return error_handling(res, main,
                                   "parse_compound_list expected WORD");
         // parse individual command
         sub = NULL;
         if (parse_and_or(&sub, lexer) != PARSER_OK)
-            return error_handling(res, main, &next, "parse_compound_list");
+            return error_handling(res, main, "parse_compound_list");
 
         // append the parsed command sub as a child of the command list
         ast_append_son(main, sub);
 
         // check if the next token is ';'
-        token_free(next);
         next = lexer_peek(lexer);
     }
 
     // set result to the constructed list
     *res = main;
-    // free the last token peeked
-    token_free(next);
     return PARSER_OK;
 }
 
@@ -1049,45 +1043,40 @@ static enum parser_status parse_while_until(struct ast **res,
 {
     struct token next = lexer_peek(lexer);
     if (next.type != TOKEN_WHILE && next.type != TOKEN_UNTIL)
-        return error_handling(res, NULL, &next,
+        return error_handling(res, NULL,
                               "parse_while_until expected WHILE or UNTIL");
 
     // build the ast containing the while rule
     struct ast *main =
         ast_new(next.type == TOKEN_WHILE ? AST_WHILE : AST_UNTIL, NULL);
     if (!main)
-        return error_handling(res, NULL, &next, "parse_while_until MEMORY");
-    token_free(lexer_pop(lexer));
+        return error_handling(res, NULL, "parse_while_until MEMORY");
+    lexer_pop(lexer);
 
     // condition compound list
     struct ast *sub = NULL;
     if (parse_compound_list(&sub, lexer) != PARSER_OK)
-        return error_handling(res, main, &next, "parse_while_until");
+        return error_handling(res, main, "parse_while_until");
     ast_append_son(main, sub);
 
     // 'do'
-    token_free(next);
     next = lexer_peek(lexer);
     if (next.type != TOKEN_DO)
-        return error_handling(res, main, &next,
-                              "parse_while_until expected DO");
-    token_free(lexer_pop(lexer));
+        return error_handling(res, main, "parse_while_until expected DO");
+    lexer_pop(lexer);
 
     // loop compound list
     sub = NULL;
     if (parse_compound_list(&sub, lexer) != PARSER_OK)
-        return error_handling(res, main, &next, "parse_while_until");
+        return error_handling(res, main, "parse_while_until");
     ast_append_son(main, sub);
 
     // 'done'
-    token_free(next);
     next = lexer_peek(lexer);
     if (next.type != TOKEN_DONE)
-        return error_handling(res, main, &next,
-                              "parse_while_until expected DONE");
-    token_free(lexer_pop(lexer));
+        return error_handling(res, main, "parse_while_until expected DONE");
+    lexer_pop(lexer);
 
-    token_free(next);
     *res = main;
     return PARSER_OK;
 }
@@ -1098,6 +1087,7 @@ size_t default_ionumber(enum token_type type)
     {
     case TOKEN_REDIR_IN:
     case TOKEN_REDIR_DUP_IN:
+    case TOKEN_HEREDOC:
         return 0;
     case TOKEN_REDIR_OUT:
     case TOKEN_REDIR_APP_OUT:
@@ -1111,6 +1101,7 @@ size_t default_ionumber(enum token_type type)
 
 // redirection =
 // [IONUMBER] ( '>' | '<' | '>>' | '>&' | '<&' | '>|' | '<>' ) WORD
+// | [IONUMBER] ( '<<' | '<<-' ) HEREDOC
 static enum parser_status parse_redirection(struct ast **res,
                                             struct lexer *lexer)
 {
@@ -1118,8 +1109,7 @@ static enum parser_status parse_redirection(struct ast **res,
     if (!could_be_redir(redir_tok))
     {
         // If the token is not a redirection token, this is unexpected
-        return error_handling(res, NULL, &redir_tok,
-                              "Expected redirection token");
+        return error_handling(res, NULL, "Expected redirection token");
     }
 
     struct token ionumber_tok = { .type = TOKEN_ERROR };
@@ -1130,43 +1120,58 @@ static enum parser_status parse_redirection(struct ast **res,
         if (!could_be_redir(redir_tok))
         {
             // If the token is not a redirection token, this is unexpected
-            return error_handling(res, NULL, &redir_tok,
-                                  "Expected redirection token");
+            return error_handling(res, NULL, "Expected redirection token");
         }
     }
 
-    struct token file_tok = lexer_pop(lexer); // Consume the filename token
-    if (!could_be_word(file_tok))
+    enum ast_type type = get_ast_type_from_token(redir_tok.type);
+    char *value;
+    if (redir_tok.type == TOKEN_HEREDOC)
+    {
+        // The lexer already read the delimiter and located the body
+        if (redir_tok.heredoc->quoted)
+            type = AST_REDIR_HEREDOC_QUOTED;
+        char *body = lexer_heredoc_dup(lexer, redir_tok);
+        value = body == NULL ? NULL : ast_strndup(body, strlen(body));
+        free(body);
+    }
+    else
     {
-        // If the filename is not a word, this is unexpected
-        token_free(redir_tok);
-        return error_handling(res, NULL, &file_tok,
-                              "Expected filename for redirection");
+        struct token file_tok = lexer_pop(lexer); // Consume the filename
+        if (!could_be_word(file_tok))
+        {
+            // If the filename is not a word, this is unexpected
+            return error_handling(res, NULL,
+                                  "Expected filename for redirection");
+        }
+        size_t len;
+        const char *text = lexer_token_text(lexer, file_tok, &len);
+        value = ast_strndup(text, len);
     }
 
-    // Create the AST node for the redirection with the filename
-    struct ast *main =
-        ast_new(get_ast_type_from_token(redir_tok.type), file_tok.value);
+    // Create the AST node for the redirection with the filename or body
+    struct ast *main = ast_new(type, value);
     if (main == NULL)
     {
         // Handle memory allocation failure
-        token_free(file_tok);
-        return error_handling(res, NULL, &redir_tok,
+        return error_handling(res, NULL,
                               "Memory allocation failed for redirection node");
     }
 
     // If we have a specified IO number, we use it
     if (ionumber_tok.type != TOKEN_ERROR)
     {
-        main->nb_sons = atoi(ionumber_tok.value);
-        token_free(ionumber_tok);
+        size_t len;
+        const char *digits = lexer_token_text(lexer, ionumber_tok, &len);
+        main->ionumber = 0;
+        for (size_t i = 0; i < len; ++i)
+            main->ionumber = main->ionumber * 10 + digits[i] - '0';
     }
     // Otherwise, we get a default value
     else
-        main->nb_sons = default_ionumber(redir_tok.type);
+        main->ionumber = default_ionumber(redir_tok.type);
 
     *res = main;
-    token_free(redir_tok);
     return PARSER_OK;
 }
 
@@ -1175,62 +1180,54 @@ static enum parser_status parse_subshell(struct ast **res, struct lexer *lexer)
     struct token next = lexer_pop(lexer);
     if (next.type != TOKEN_LPAREN)
     {
-        return error_handling(res, NULL, &next,
-                              "Expected '(' for subshell start.");
+        return error_handling(res, NULL, "Expected '(' for subshell start.");
     }
     struct ast *compound_list = NULL;
     enum parser_status status = parse_compound_list(
         &compound_list, lexer); // Analyse les commandes internes
     if (status != PARSER_OK)
     {
-        token_free(next);
         return status;
     }
-    token_free(next);
     next = lexer_peek(lexer);
     if (next.type != TOKEN_RPAREN)
     {
         ast_free(compound_list);
-        return error_handling(res, NULL, &next,
-                              "Expected ')' for subshell end.");
+        return error_handling(res, NULL, "Expected ')' for subshell end.");
     }
     *res = ast_new(AST_SUBSHELL, NULL);
     if (*res == NULL)
     {
         ast_free(compound_list);
-        return error_handling(res, NULL, &next,
+        return error_handling(res, NULL,
                               "Memory allocation failed for subshell.");
     }
     ast_append_son(*res, compound_list);
-    token_free(lexer_pop(lexer));
-    token_free(next);
+    lexer_pop(lexer);
     return PARSER_OK;
 }
 
 static enum parser_status parse_funcdec(struct ast **res, struct lexer *lexer)
 {
-    struct token next = lexer_peek(lexer);
-    if (next.type != TOKEN_FUNCTION_WORD)
-        return error_handling(res, NULL, &next,
-                              "parse_funcdec expected FUNCTION_WORD");
-    struct ast *funcdec = ast_new(AST_FUNCDEC, lexer_pop(lexer).value);
+    if (!starts_funcdec(lexer))
+        return error_handling(res, NULL, "parse_funcdec expected WORD '(' ')'");
+    struct ast *funcdec = ast_new(AST_FUNCDEC, pop_value(lexer));
+    lexer_pop(lexer); // '('
+    lexer_pop(lexer); // ')'
 
     // trim interfering newlines
-    token_free(next);
-    next = lexer_peek(lexer);
+    struct token next = lexer_peek(lexer);
     while (next.type == TOKEN_LF)
     {
-        token_free(next);
-        token_free(lexer_pop(lexer));
+        lexer_pop(lexer);
         next = lexer_peek(lexer);
     }
 
     struct ast *inside = NULL;
     if (parse_command(&inside, lexer) != PARSER_OK)
-        return error_handling(res, funcdec, &next, "parse_funcdec");
+        return error_handling(res, funcdec, "parse_funcdec");
     ast_append_son(funcdec, inside);
 
     *res = funcdec;
-    token_free(next);
     return PARSER_OK;
 }
@@ -1,6 +1,7 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "arena/arena.h"
 #include "ast.h"
 #include "lexer.h"
 #include "token.h"
@@ -21,12 +22,47 @@ enum parser_status
     PARSER_UNEXPECTED_TOKEN,
 };
 
+/*
+** The top-level commands of a script, in the order they are run
+*/
+struct script
+{
+    struct ast **asts;
+    size_t nb_asts;
+    size_t capacity;
+    struct arena arena; // Holds the nodes of the commands and their values
+};
+
+/**
+ ** \brief Appends a command to the script, which now owns it. Returns 0 on
+ ** error.
+ */
+int script_append(struct script *script, struct ast *ast);
+
+/**
+ ** \brief Frees the commands of the script that are still in it, and its
+ ** arena.
+ */
+void script_free(struct script *script);
+
+/**
+ ** \brief Parses everything the lexer reads at once, quietly. Returns 0 if
+ ** it has an error, leaving script empty: it must then be run unit by unit,
+ ** so that the units before the error still run and the error is printed.
+ */
+int parse_script(struct script *script, struct lexer *lexer);
+
+/**
+ ** \brief Stops or resumes printing the parsing errors (default: printed).
+ */
+void parser_set_quiet(int quiet);
+
 /**
  ** \brief Shortcut function. Frees arguments, sets *res to NULL,
  **        prints an error on stderr, and returns an error.
  */
 enum parser_status error_handling(struct ast **res, struct ast *other_free,
-                                  struct token *token, char *hint);
+                                  char *hint);
 
 /**
  ** \brief Parses one shell 'input'.
@@ -0,0 +1,251 @@
+#define _POSIX_C_SOURCE 200809L // strdup
+
+#include "path_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../fnv.h"
+
+static struct path_entry **buckets = NULL;
+static size_t nb_buckets = 0;
+static size_t nb_entries = 0;
+// The $PATH the entries were searched in
+static char *searched_path = NULL;
+
+static struct path_entry **find(const char *name)
+{
+    size_t index = fnv_hash_string(name) & (nb_buckets - 1);
+    struct path_entry **entry = &buckets[index];
+    while (*entry != NULL && strcmp((*entry)->name, name) != 0)
+        entry = &(*entry)->next;
+    return entry;
+}
+
+// Doubles the buckets once there are as many entries
+static int grow(void)
+{
+    size_t size = nb_buckets ? 2 * nb_buckets : PATH_CACHE_MIN_SIZE;
+    struct path_entry **table = calloc(size, sizeof(struct path_entry *));
+    if (table == NULL)
+        return 0;
+
+    for (size_t i = 0; i < nb_buckets; ++i)
+    {
+        while (buckets[i] != NULL)
+        {
+            struct path_entry *entry = buckets[i];
+            buckets[i] = entry->next;
+            size_t index = fnv_hash_string(entry->name) & (size - 1);
+            entry->next = table[index];
+            table[index] = entry;
+        }
+    }
+
+    free(buckets);
+    buckets = table;
+    nb_buckets = size;
+    return 1;
+}
+
+static void entry_free(struct path_entry *entry)
+{
+    free(entry->name);
+    free(entry->path);
+    free(entry);
+}
+
+// Forgets everything once $PATH is not the one the entries were found in
+static int check_path(const char *path)
+{
+    if (searched_path != NULL && strcmp(searched_path, path) == 0)
+        return 1;
+
+    path_cache_clear();
+    searched_path = strdup(path);
+    return searched_path != NULL;
+}
+
+/*
+** The first executable regular file named name in the directories of path,
+** as execvp would run it. Sets *relative if a relative directory had to be
+** searched: the result would depend on the current directory.
+*/
+static char *search(const char *name, const char *path, int *relative)
+{
+    size_t name_len = strlen(name);
+    *relative = 0;
+    while (1)
+    {
+        const char *end = strchr(path, ':');
+        size_t dir_len = end != NULL ? (size_t)(end - path) : strlen(path);
+        // An empty directory is the current one
+        const char *dir = dir_len == 0 ? "." : path;
+        if (dir_len == 0)
+            dir_len = 1;
+        if (*dir != '/')
+            *relative = 1;
+
+        char *file = malloc(dir_len + 1 + name_len + 1);
+        if (file == NULL)
+            return NULL;
+        memcpy(file, dir, dir_len);
+        file[dir_len] = '/';
+        memcpy(file + dir_len + 1, name, name_len + 1);
+
+        struct stat st;
+        if (stat(file, &st) == 0 && S_ISREG(st.st_mode)
+            && access(file, X_OK) == 0)
+            return file;
+        free(file);
+
+        if (end == NULL)
+            return NULL;
+        path = end + 1;
+    }
+}
+
+// Adds an entry for name, whose path is NULL. NULL if error.
+static struct path_entry *add(struct path_entry **slot, const char *name)
+{
+    struct path_entry *entry = calloc(1, sizeof(*entry));
+    if (entry == NULL || (entry->name = strdup(name)) == NULL)
+    {
+        free(entry);
+        return NULL;
+    }
+    *slot = entry;
+
+    if (++nb_entries > nb_buckets)
+        grow(); // Lookups only get slower if it fails
+    return entry;
+}
+
+/*
+** The entry of name, searched and added if needed. NULL if not remembered.
+** Only a path that is still executable is trusted: commands that were not
+** found, or whose file is gone, are searched again.
+*/
+static struct path_entry *get(const char *name)
+{
+    const char *path = getenv("PATH");
+    if (strchr(name, '/') != NULL || *name == '\0' || path == NULL
+        || !check_path(path))
+        return NULL;
+
+    if (nb_buckets == 0 && !grow())
+        return NULL;
+    struct path_entry **slot = find(name);
+    struct path_entry *entry = *slot;
+    if (entry != NULL && entry->path != NULL && access(entry->path, X_OK) == 0)
+        return entry;
+
+    int relative;
+    char *file = search(name, path, &relative);
+    if (relative)
+    {
+        free(file);
+        path_cache_forget(name);
+        return NULL;
+    }
+    if (entry == NULL && (entry = add(slot, name)) == NULL)
+    {
+        free(file);
+        return NULL;
+    }
+    free(entry->path);
+    entry->path = file;
+    return entry;
+}
+
+enum path_status path_cache_lookup(const char *name, const char **path)
+{
+    struct path_entry *entry = get(name);
+    if (entry == NULL)
+        return PATH_UNKNOWN;
+
+    entry->hits++;
+    *path = entry->path;
+    return entry->path != NULL ? PATH_FOUND : PATH_NOT_FOUND;
+}
+
+enum path_status path_cache_add(const char *name, const char **path)
+{
+    struct path_entry *entry = get(name);
+    if (entry == NULL)
+        return PATH_UNKNOWN;
+
+    if (path != NULL)
+        *path = entry->path;
+    return entry->path != NULL ? PATH_FOUND : PATH_NOT_FOUND;
+}
+
+char *path_cache_search(const char *name)
+{
+    const char *path = getenv("PATH");
+    int relative;
+    if (strchr(name, '/') != NULL || *name == '\0' || path == NULL)
+        return NULL;
+    return search(name, path, &relative);
+}
+
+void path_cache_forget(const char *name)
+{
+    if (nb_buckets == 0)
+        return;
+
+    struct path_entry **slot = find(name);
+    if (*slot != NULL)
+    {
+        struct path_entry *entry = *slot;
+        *slot = entry->next;
+        entry_free(entry);
+        --nb_entries;
+    }
+}
+
+void path_cache_clear(void)
+{
+    for (size_t i = 0; i < nb_buckets; ++i)
+    {
+        while (buckets[i] != NULL)
+        {
+            struct path_entry *entry = buckets[i];
+            buckets[i] = entry->next;
+            entry_free(entry);
+        }
+    }
+
+    nb_entries = 0;
+    free(searched_path);
+    searched_path = NULL;
+}
+
+size_t path_cache_print(void)
+{
+    size_t nb_found = 0;
+    for (size_t i = 0; i < nb_buckets; ++i)
+    {
+        for (struct path_entry *entry = buckets[i]; entry; entry = entry->next)
+        {
+            if (entry->path == NULL)
+                continue;
+            if (nb_found++ == 0)
+                printf("hits\tcommand\n");
+            printf("%4zu\t%s\n", entry->hits, entry->path);
+        }
+    }
+
+    return nb_found;
+}
+
+void path_cache_destroy(void)
+{
+    path_cache_clear();
+    free(buckets);
+    buckets = NULL;
+    nb_buckets = 0;
+}
@@ -0,0 +1,70 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <stddef.h>
+
+#define PATH_CACHE_MIN_SIZE 64 // First number of buckets, a power of two
+
+enum path_status
+{
+    PATH_UNKNOWN, // Not remembered: the name has a '/', or PATH is relative
+    PATH_FOUND,
+    PATH_NOT_FOUND,
+};
+
+/*
+** Where the commands run were found in PATH, by name. Commands that were not
+** found are remembered too, and searched again each time they are looked up
+** in case they were installed since.
+*/
+struct path_entry
+{
+    char *name;
+    char *path; ///< Absolute path of the command, NULL if not found
+    size_t hits; ///< Number of times it was looked up
+    struct path_entry *next;
+};
+
+/*
+** \brief Finds the command name in the directories of $PATH, searching them
+** only if no executable file is remembered for it: the remembered path is
+** checked with a single access(2), as bash's checkhash does. Sets *path to
+** its absolute path if found. Results found through a relative directory of
+** $PATH are not remembered: PATH_UNKNOWN is returned, execvp must search it.
+**
+** Everything is forgotten once $PATH changes.
+*/
+enum path_status path_cache_lookup(const char *name, const char **path);
+
+/*
+** \brief Searches name and remembers it without counting a hit, as the hash
+** builtin and `command -v` do. Sets *path as path_cache_lookup, unless path
+** is NULL.
+*/
+enum path_status path_cache_add(const char *name, const char **path);
+
+/*
+** \brief Searches name in $PATH, relative directories included, without
+** remembering it. Returns its path, to be freed, or NULL if not found.
+*/
+char *path_cache_search(const char *name);
+
+/*
+** \brief Forgets name, for instance once its path turned out to be gone.
+*/
+void path_cache_forget(const char *name);
+
+/*
+** \brief Forgets every command, as when $PATH is assigned or `hash -r`.
+*/
+void path_cache_clear(void);
+
+/*
+** \brief Prints the commands found in PATH and their hits on stdout. Returns
+** their number.
+*/
+size_t path_cache_print(void);
+
+void path_cache_destroy(void);
+
+#endif /* ! PATH_CACHE_H */
@@ -15,9 +15,11 @@ run_test false
 run_test export_builtin
 run_test export_builtin_2
 run_test export_builtin_3
+run_test path_cache
 run_test dot_builtin
 run_test dot_builtin_2
 run_test dot_builtin_error
+run_test dot_builtin_loop
 
 run_test exit_nocode
 run_test exit_code0
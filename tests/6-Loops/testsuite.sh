@@ -3,6 +3,7 @@ echo "$YELLOW==== Loops ====$WHITE"
 run_test while_false
 run_test until_true
 run_test for_no_var_use
+run_test for_expanded_words
 
 run_test while_break
 run_test until_break
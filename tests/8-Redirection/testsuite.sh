@@ -16,6 +16,8 @@ run_test redir_out_fd45_cat
 run_test redir_rw_man
 run_test redir_rw_grep
 
+run_test redir_heredoc
+
 run_test redir_multiple
 run_test redir_function
 run_test redir_if